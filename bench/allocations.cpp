@@ -0,0 +1,93 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+// Replaces malloc and friends for the whole process, so allocations made inside ArduinoJson and libstdc++
+// are counted too. Only <stddef.h> and <malloc.h> are included, to keep clear of <stdlib.h>'s declarations.
+#include "allocations.h"
+
+#include <atomic>
+#include <malloc.h>
+
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* pointer, size_t size);
+    void __libc_free(void* pointer);
+}
+
+namespace {
+    std::atomic<uint64_t> allocationCount { 0 };
+    std::atomic<uint64_t> allocationBytes { 0 };
+    std::atomic<size_t> liveBytes { 0 };
+    std::atomic<size_t> peakBytes { 0 };
+    // Constant-initialised, so reading it from inside malloc never allocates
+    thread_local uint64_t threadAllocations = 0;
+
+    void added(void* pointer, size_t requested) {
+        if (!pointer) return;
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        ++threadAllocations;
+        allocationBytes.fetch_add(requested, std::memory_order_relaxed);
+
+        size_t live = liveBytes.fetch_add(malloc_usable_size(pointer), std::memory_order_relaxed)
+            + malloc_usable_size(pointer);
+        size_t peak = peakBytes.load(std::memory_order_relaxed);
+        while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    }
+
+    void removed(void* pointer) {
+        if (pointer) liveBytes.fetch_sub(malloc_usable_size(pointer), std::memory_order_relaxed);
+    }
+}
+
+extern "C" {
+    void* malloc(size_t size) noexcept {
+        void* pointer = __libc_malloc(size);
+        added(pointer, size);
+        return pointer;
+    }
+
+    void* calloc(size_t count, size_t size) noexcept {
+        void* pointer = __libc_calloc(count, size);
+        added(pointer, count * size);
+        return pointer;
+    }
+
+    void* realloc(void* pointer, size_t size) noexcept {
+        removed(pointer);
+        void* resized = __libc_realloc(pointer, size);
+        // A failed realloc leaves the old block in place
+        added(resized ? resized : (size ? pointer : nullptr), size);
+        return resized;
+    }
+
+    void free(void* pointer) noexcept {
+        removed(pointer);
+        __libc_free(pointer);
+    }
+}
+
+namespace Bench::Allocations {
+    uint64_t count() { return allocationCount.load(std::memory_order_relaxed); }
+    uint64_t bytes() { return allocationBytes.load(std::memory_order_relaxed); }
+    uint64_t threadCount() { return threadAllocations; }
+    size_t live() { return liveBytes.load(std::memory_order_relaxed); }
+    size_t peak() { return peakBytes.load(std::memory_order_relaxed); }
+    void resetPeak() { peakBytes.store(liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed); }
+}
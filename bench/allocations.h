@@ -0,0 +1,39 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _DISCORD_ESP32A_BENCH_ALLOCATIONS_H_
+#define _DISCORD_ESP32A_BENCH_ALLOCATIONS_H_
+
+// Process-wide heap counters, fed by malloc/realloc/calloc replacements in allocations.cpp (glibc only)
+namespace Bench::Allocations {
+    uint64_t count();
+    uint64_t bytes();
+    // Allocations made by the calling thread only, so other tasks' work doesn't blur a measurement
+    uint64_t threadCount();
+    // Bytes currently allocated, and the most ever allocated at once since the last resetPeak()
+    size_t live();
+    size_t peak();
+    void resetPeak();
+}
+
+#endif //_DISCORD_ESP32A_BENCH_ALLOCATIONS_H_
@@ -0,0 +1,274 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+// Microbenchmarks for the gateway client, run on the host against lib/NativeFakes:
+//   pio run -e native && .pio/build/native/program
+// or replay a gateway capture (see capture.h) instead:
+//   .pio/build/native/program replay guild.cap [--realtime]
+// Each line reports throughput and heap allocations per operation. Gateway frames are delivered through the
+// fake WebSocketsClient, so they take the same path through Bot::onWebSocketEvents as on the device.
+
+#include <Arduino.h>
+#include <discord.h>
+#include <eventring.h>
+#include <interactions.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "benchmark.h"
+#include "replay.h"
+
+// Tests link the same sources and bring their own main()
+#ifndef PIO_UNIT_TESTING
+
+namespace {
+    const char* botToken = "MTEwMDAwMDAwMDAwMDAwMDAwMA.Gbench.benchmark-token-not-a-real-one-0000000000";
+    const uint64_t applicationId = 1100000000000000000ULL;
+
+    char helloFrame[] =
+        "{\"t\":null,\"s\":null,\"op\":10,\"d\":{\"heartbeat_interval\":41250,"
+        "\"_trace\":[\"[\\\"gateway-prd-us-east1-b-0568\\\",{\\\"micros\\\":0.0}]\"]}}";
+
+    char readyFrame[] =
+        "{\"t\":\"READY\",\"s\":1,\"op\":0,\"d\":{\"v\":10,\"user_settings\":{},"
+        "\"user\":{\"verified\":true,\"username\":\"WakeBot\",\"mfa_enabled\":false,\"id\":\"1100000000000000000\","
+        "\"global_name\":null,\"flags\":0,\"email\":null,\"discriminator\":\"0420\",\"bot\":true,\"avatar\":null},"
+        "\"session_type\":\"normal\",\"session_id\":\"4a5d3c9e8f7b6a5d4c3b2a1f0e9d8c7b\","
+        "\"resume_gateway_url\":\"wss://gateway-us-east1-b.discord.gg\",\"relationships\":[],\"private_channels\":[],"
+        "\"presences\":[],\"guilds\":[{\"unavailable\":true,\"id\":\"1000000000000000001\"}],\"guild_join_requests\":[],"
+        "\"geo_ordered_rtc_regions\":[\"singapore\",\"hongkong\",\"japan\",\"india\",\"sydney\"],"
+        "\"auth\":{},\"application\":{\"id\":\"1100000000000000000\",\"flags\":565248},"
+        "\"_trace\":[\"[\\\"gateway-prd-us-east1-b-0568\\\",{\\\"micros\\\":128394}]\"]}}";
+
+    char heartbeatAckFrame[] = "{\"t\":null,\"s\":null,\"op\":11,\"d\":null}";
+
+    char messageCreateFrame[] =
+        "{\"t\":\"MESSAGE_CREATE\",\"s\":2,\"op\":0,\"d\":{\"type\":0,\"tts\":false,"
+        "\"timestamp\":\"2023-08-19T12:34:56.789000+00:00\",\"referenced_message\":null,\"pinned\":false,"
+        "\"nonce\":\"1142380000000000000\",\"mentions\":[],\"mention_roles\":[],\"mention_everyone\":false,"
+        "\"member\":{\"roles\":[\"1000000000000000010\"],\"premium_since\":null,\"pending\":false,\"nick\":null,"
+        "\"mute\":false,\"joined_at\":\"2021-02-03T04:05:06.000000+00:00\",\"flags\":0,\"deaf\":false,"
+        "\"communication_disabled_until\":null,\"avatar\":null},\"id\":\"1142380000000000001\",\"flags\":0,"
+        "\"embeds\":[],\"edited_timestamp\":null,\"content\":\"is the pc on?\",\"components\":[],"
+        "\"channel_id\":\"1000000000000000002\",\"author\":{\"username\":\"someone\",\"public_flags\":0,"
+        "\"id\":\"1000000000000000003\",\"global_name\":\"Someone\",\"discriminator\":\"0\",\"avatar\":null},"
+        "\"attachments\":[],\"guild_id\":\"1000000000000000001\"}}";
+
+    char interactionCreateFrame[] =
+        "{\"t\":\"INTERACTION_CREATE\",\"s\":3,\"op\":0,\"d\":{\"version\":1,\"type\":2,"
+        "\"token\":\"aW50ZXJhY3Rpb246MTE0MjM4MDAwMDAwMDAwMDAwNDpiZW5jaG1hcmt0b2tlbmJlbmNobWFya3Rva2VuYmVuY2htYXJrdG9r"
+        "ZW5iZW5jaG1hcmt0b2tlbmJlbmNobWFya3Rva2VuYmVuY2htYXJrdG9rZW5iZW5jaG1hcmt0b2tlbmJlbmNobWFya3Rva2VuYmVuY2htYXJr"
+        "dG9rZW5iZW5jaG1hcmt0b2tlbmJlbmNobWFya3Rva2VuYmVuY2htYXJrdG9rZW5iZW5jaG1hcmt0b2tlbg\","
+        "\"member\":{\"user\":{\"username\":\"someone\",\"public_flags\":0,\"id\":\"1000000000000000003\","
+        "\"global_name\":\"Someone\",\"discriminator\":\"0\",\"avatar\":null},\"roles\":[\"1000000000000000010\"],"
+        "\"premium_since\":null,\"permissions\":\"562949953421311\",\"pending\":false,\"nick\":null,\"mute\":false,"
+        "\"joined_at\":\"2021-02-03T04:05:06.000000+00:00\",\"flags\":0,\"deaf\":false,"
+        "\"communication_disabled_until\":null,\"avatar\":null},\"locale\":\"en-GB\",\"id\":\"1142380000000000004\","
+        "\"guild_locale\":\"en-US\",\"guild_id\":\"1000000000000000001\",\"entitlements\":[],"
+        "\"entitlement_sku_ids\":[],\"data\":{\"type\":1,\"name\":\"wake\",\"id\":\"1100000000000000005\"},"
+        "\"channel_id\":\"1000000000000000002\",\"application_id\":\"1100000000000000000\","
+        "\"app_permissions\":\"562949953421311\"}}";
+
+    WebSocketsClient* socket = nullptr;
+    std::atomic<unsigned long> interactionsHandled { 0 };
+
+    void deliver(char* frame) {
+        socket->receive(WStype_TEXT, reinterpret_cast<uint8_t*>(frame), strlen(frame));
+    }
+
+
+    Discord::Interactions::ApplicationCommand::Option::Choice targetChoices[] = {
+        { "Desktop", "desktop", 0, 0 },
+        { "Laptop", "laptop", 0, 0 },
+        { "Media server", "media", 0, 0 }
+    };
+
+    Discord::Interactions::ApplicationCommand::Option wakeOptions[] = {
+        { "target", "Machine to wake.", Discord::Interactions::ApplicationCommand::OptionType::STRING, true,
+            targetChoices, sizeof(targetChoices) / sizeof(targetChoices[0]) },
+        { "wait", "Wait until the machine answers pings.", Discord::Interactions::ApplicationCommand::OptionType::BOOLEAN,
+            false, nullptr, 0 }
+    };
+
+    struct BenchRecord {
+        uint32_t sequence;
+        uint32_t type;
+        // When it was pushed, in ns on the steady clock
+        uint64_t pushedAt;
+        void* frame;
+    };
+
+    uint64_t nanosNow() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Push to pop latencies in power of two buckets, so the consumer records them without allocating
+    struct LatencyHistogram {
+        unsigned long buckets[64] = {};
+        unsigned long count = 0;
+        uint64_t max = 0;
+
+        void add(uint64_t ns) {
+            unsigned int bucket = 0;
+            while (bucket < 63 && (1ULL << (bucket + 1)) <= ns) ++bucket;
+            ++buckets[bucket];
+            ++count;
+            if (ns > max) max = ns;
+        }
+
+        // Upper bound of the bucket holding the given fraction of samples, in ns
+        uint64_t percentile(double fraction) const {
+            unsigned long target = static_cast<unsigned long>(count * fraction);
+            unsigned long seen = 0;
+            for (unsigned int bucket = 0; bucket < 64; ++bucket) {
+                seen += buckets[bucket];
+                if (seen > target) return (2ULL << bucket) < max ? 2ULL << bucket : max;
+            }
+            return max;
+        }
+    };
+
+    // One producer and one consumer thread passing records through the same ring the gateway and worker tasks use.
+    // With Reject the producer retries until each record is stored, so retries aren't losses.
+    void benchEventRing(const char* name, Discord::RingPolicy policy) {
+        Discord::EventRing<BenchRecord, DISCORD_EVENT_RING_SIZE>* active =
+            new Discord::EventRing<BenchRecord, DISCORD_EVENT_RING_SIZE>(policy);
+        std::atomic<bool> stop { false };
+        unsigned long consumed = 0;
+        unsigned long outOfOrder = 0;
+        LatencyHistogram* latency = new LatencyHistogram();
+
+        std::thread consumer([&]() {
+            BenchRecord record;
+            uint32_t last = 0;
+            // Drains the ring after the producer stops, so every stored record is accounted for.
+            for (;;) {
+                bool done = stop.load();
+                if (active->pop(record)) {
+                    latency->add(nanosNow() - record.pushedAt);
+                    if (record.sequence <= last) ++outOfOrder;
+                    last = record.sequence;
+                    ++consumed;
+                }
+                else if (done) {
+                    break;
+                }
+                else {
+                    std::this_thread::yield();
+                }
+            }
+            });
+
+        uint32_t sequence = 0;
+        unsigned long retries = 0;
+        unsigned long evicted = 0;
+        Bench::run(name, [&]() {
+            BenchRecord record { ++sequence, 0, nanosNow(), nullptr };
+            Discord::PushResult result;
+            while ((result = active->push(record)) == Discord::PushResult::Rejected) {
+                ++retries;
+                std::this_thread::yield();
+                record.pushedAt = nanosNow();
+            }
+            if (result == Discord::PushResult::Evicted) ++evicted;
+            });
+
+        stop = true;
+        consumer.join();
+        unsigned long lost = sequence - consumed - evicted;
+        printf("%-32s produced %u, consumed %lu, evicted %lu, retries %lu, lost %lu, out of order %lu\n", "",
+            sequence, consumed, evicted, retries, lost, outOfOrder);
+        printf("%-32s latency p50 < %.1f us, p99 < %.1f us, max %.1f us; peak occupancy %zu of %zu\n", "",
+            latency->percentile(0.5) / 1000.0, latency->percentile(0.99) / 1000.0, latency->max / 1000.0,
+            active->highWater(), active->slots());
+        if (lost || outOfOrder) printf("%-32s FAILED: records lost or reordered\n", "");
+        delete latency;
+        delete active;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "replay") == 0) {
+        if (argc < 3) {
+            printf("Usage: %s replay <capture> [--realtime]\n", argv[0]);
+            return 2;
+        }
+        return Bench::replay(argv[2], argc > 3 && strcmp(argv[3], "--realtime") == 0);
+    }
+
+    Discord::Bot bot(botToken, applicationId);
+    bot.onInteraction([](const char*, const Discord::Interaction&) {
+        interactionsHandled.fetch_add(1, std::memory_order_relaxed);
+        });
+    bot.login();
+    socket = WebSocketsClient::last;
+
+    // Bring the session up the way the gateway does: connect, HELLO (answered by IDENTIFY), READY.
+    socket->receive(WStype_CONNECTED);
+    deliver(helloFrame);
+    deliver(readyFrame);
+    if (!bot.online()) {
+        printf("Bot did not come online against the fake gateway.\n");
+        return 1;
+    }
+
+    Bench::printHeader();
+
+    Bench::run("parse/heartbeat_ack", []() { deliver(heartbeatAckFrame); });
+    Bench::run("parse/message_create", []() { deliver(messageCreateFrame); });
+    Bench::run("parse/ready", []() { deliver(readyFrame); });
+
+    // Without begin() there is no worker task, so the interaction is parsed and handed to the callback inline.
+    Bench::run("dispatch/interaction_create", []() { deliver(interactionCreateFrame); });
+    benchEventRing("dispatch/event_ring_reject", Discord::RingPolicy::Reject);
+    benchEventRing("dispatch/event_ring_overwrite", Discord::RingPolicy::Overwrite);
+
+    Bench::run("serialize/command", []() {
+        Discord::Interactions::ApplicationCommand command;
+        command.name = "wake";
+        command.type = Discord::Interactions::CommandType::CHAT_INPUT;
+        command.description = "Send wake signal to PC.";
+        command.options = wakeOptions;
+        command.optionsLength = sizeof(wakeOptions) / sizeof(wakeOptions[0]);
+        command.default_member_permissions = 0;
+
+        StaticJsonDocument<1024> doc;
+        char json[1024];
+        Discord::Interactions::serializeCommand(command, doc);
+        serializeJson(doc, json, sizeof(json));
+        });
+
+    // Each response is queued into a slot and sent by the responder task; waiting for it to finish keeps the
+    // slots from running out, so this measures the whole round trip to the (instant) fake HTTP client.
+    Bench::run("response/message", [&bot]() {
+        Discord::Bot::MessageResponse response;
+        response.content = "Wake signal sent.";
+        bot.sendCommandResponse(Discord::Bot::InteractionResponse::CHANNEL_MESSAGE_WITH_SOURCE, response);
+        while (bot.inFlightResponses() > 0) std::this_thread::yield();
+        });
+
+    printf("\n%lu interactions handled, %lu HTTP requests, %lu gateway frames sent\n",
+        interactionsHandled.load(), HTTPClient::requests.load(), socket->framesSent);
+    return 0;
+}
+
+#endif //PIO_UNIT_TESTING
@@ -0,0 +1,89 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <chrono>
+#include <stdio.h>
+
+#include "allocations.h"
+
+#ifndef _DISCORD_ESP32A_BENCH_BENCHMARK_H_
+#define _DISCORD_ESP32A_BENCH_BENCHMARK_H_
+
+// How long each benchmark runs for, after a short warm-up
+#ifndef BENCH_MIN_SECONDS
+#define BENCH_MIN_SECONDS 1.0
+#endif
+#define BENCH_WARMUP_OPS 100
+
+namespace Bench {
+    struct Result {
+        const char* name;
+        unsigned long ops;
+        double seconds;
+        double allocationsPerOp;
+        double bytesPerOp;
+    };
+
+    inline void printHeader() {
+        printf("%-32s %12s %12s %12s %12s\n", "benchmark", "ops", "ops/sec", "allocs/op", "bytes/op");
+    }
+
+    inline void print(const Result& result) {
+        printf("%-32s %12lu %12.0f %12.2f %12.1f\n", result.name, result.ops, result.ops / result.seconds,
+            result.allocationsPerOp, result.bytesPerOp);
+    }
+
+    /// @brief Runs op repeatedly for at least BENCH_MIN_SECONDS and prints its throughput and heap use.
+    /// Allocations are counted process-wide, so anything the client's own tasks allocate meanwhile counts too.
+    /// @param name Benchmark name, printed in the first column.
+    /// @param op The operation; called with no arguments, its return value is ignored.
+    template <typename Op>
+    Result run(const char* name, Op op) {
+        using Clock = std::chrono::steady_clock;
+
+        for (unsigned long i = 0; i < BENCH_WARMUP_OPS; ++i) op();
+
+        // Time batches rather than single calls, so reading the clock doesn't dominate quick operations.
+        unsigned long batch = 1;
+        unsigned long ops = 0;
+        uint64_t startCount = Allocations::count();
+        uint64_t startBytes = Allocations::bytes();
+        Clock::time_point start = Clock::now();
+        double seconds = 0;
+        while (seconds < BENCH_MIN_SECONDS) {
+            for (unsigned long i = 0; i < batch; ++i) op();
+            ops += batch;
+            if (batch < 1024) batch *= 2;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        Result result {
+            name,
+            ops,
+            seconds,
+            static_cast<double>(Allocations::count() - startCount) / ops,
+            static_cast<double>(Allocations::bytes() - startBytes) / ops
+        };
+        print(result);
+        return result;
+    }
+}
+
+#endif //_DISCORD_ESP32A_BENCH_BENCHMARK_H_
@@ -0,0 +1,310 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <Arduino.h>
+#include <capture.h>
+#include <discord.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "allocations.h"
+#include "replay.h"
+
+// Virtual time between update() calls when replaying as fast as possible, close to the gateway task's loop
+#define REPLAY_UPDATE_STEP 10
+// Divergences printed individually before only being counted
+#define REPLAY_MAX_REPORTED 5
+
+namespace Bench {
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        struct Frame {
+            unsigned long at;
+            Discord::Capture::Kind kind;
+            std::string payload;
+            // Decoded ahead of the replay, so the timed part only runs the bot
+            int op = -1;
+            long sequence = -1;
+            std::string type;
+            std::string sessionId;
+            // INVALID_SESSION's d: whether the session may be resumed
+            bool resumable = false;
+        };
+
+        struct SentFrame {
+            unsigned long at;
+            int op;
+            long sequence;
+        };
+
+        // Reads op, s, t, d.session_id and INVALID_SESSION's d from a received frame
+        void decode(Frame& frame) {
+            StaticJsonDocument<128> filter;
+            filter["op"] = true;
+            filter["s"] = true;
+            filter["t"] = true;
+            filter["d"]["session_id"] = true;
+
+            DynamicJsonDocument doc(1024);
+            if (deserializeJson(doc, frame.payload.data(), frame.payload.size(),
+                DeserializationOption::Filter(filter))) return;
+
+            frame.op = doc["op"] | -1;
+            frame.sequence = doc["s"].isNull() ? -1 : doc["s"].as<long>();
+            frame.type = doc["t"] | "";
+            frame.sessionId = doc["d"]["session_id"] | "";
+            frame.resumable = frame.op == 9 && frame.payload.find("\"d\":true") != std::string::npos;
+        }
+
+        // The bot formats its own frames with op first and a plain number or null for a heartbeat's d, so scanning
+        // is enough. Unlike a JSON document it doesn't allocate inside the timed part of the replay.
+        SentFrame decodeSent(unsigned long at, const char* payload, size_t length) {
+            SentFrame frame { at, -1, -1 };
+            const char* end = payload + length;
+            const char* op = static_cast<const char*>(memmem(payload, length, "\"op\":", 5));
+            if (op && op + 5 < end) frame.op = strtol(op + 5, nullptr, 10);
+            const char* d = static_cast<const char*>(memmem(payload, length, "\"d\":", 4));
+            if (frame.op == 1 && d && d + 4 < end && isdigit(static_cast<unsigned char>(d[4]))) {
+                frame.sequence = strtol(d + 4, nullptr, 10);
+            }
+            return frame;
+        }
+
+        bool load(const char* path, std::vector<Frame>& frames, size_t& malformed) {
+            FILE* file = fopen(path, "r");
+            if (!file) return false;
+
+            char* line = nullptr;
+            size_t capacity = 0;
+            ssize_t length;
+            unsigned long at = 0;
+            const size_t prefixLength = sizeof(DISCORD_CAPTURE_PREFIX) - 1;
+            while ((length = getline(&line, &capacity, file)) != -1) {
+                Discord::Capture::Record record;
+                if (!Discord::Capture::parse(line, length, record)) {
+                    if (strncmp(line, DISCORD_CAPTURE_PREFIX, prefixLength) == 0) ++malformed;
+                    continue;
+                }
+                at += record.delta;
+
+                Frame frame;
+                frame.at = at;
+                frame.kind = record.kind;
+                frame.payload.assign(record.payload, record.length);
+                if (frame.kind == Discord::Capture::Kind::Received) decode(frame);
+                frames.push_back(std::move(frame));
+            }
+            free(line);
+            fclose(file);
+            return true;
+        }
+
+        const char* opName(int op) {
+            switch (op) {
+                case 1: return "HEARTBEAT";
+                case 7: return "RECONNECT";
+                case 9: return "INVALID_SESSION";
+                case 10: return "HELLO";
+                case 11: return "HEARTBEAT_ACK";
+                default: return "OTHER";
+            }
+        }
+
+        uint32_t percentile(const std::vector<uint32_t>& sorted, double fraction) {
+            if (sorted.empty()) return 0;
+            size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+            return sorted[index];
+        }
+
+        void printLatencies(const char* name, std::vector<uint32_t>& latencies) {
+            std::sort(latencies.begin(), latencies.end());
+            printf("%-28s %8zu %10.1f %10.1f %10.1f %10.1f\n", name, latencies.size(),
+                percentile(latencies, 0.50) / 1000.0, percentile(latencies, 0.90) / 1000.0,
+                percentile(latencies, 0.99) / 1000.0, latencies.empty() ? 0.0 : latencies.back() / 1000.0);
+        }
+
+        // Compares the frames the bot sent with the ones in the capture, op by op in order.
+        size_t compareSent(const std::vector<Frame>& frames, const std::vector<SentFrame>& sent) {
+            std::map<int, std::vector<SentFrame>> expected;
+            std::map<int, std::vector<SentFrame>> actual;
+            for (const Frame& frame : frames) {
+                if (frame.kind == Discord::Capture::Kind::Sent) {
+                    SentFrame decoded = decodeSent(frame.at, frame.payload.data(), frame.payload.size());
+                    expected[decoded.op].push_back(decoded);
+                }
+            }
+            for (const SentFrame& frame : sent) actual[frame.op].push_back(frame);
+            for (const auto& entry : expected) actual[entry.first];
+
+            size_t divergences = 0;
+            printf("\n%-12s %10s %10s %14s %14s\n", "sent op", "captured", "replayed", "max skew ms", "seq mismatch");
+            for (const auto& entry : actual) {
+                const std::vector<SentFrame>& mine = entry.second;
+                const std::vector<SentFrame>& theirs = expected[entry.first];
+                size_t pairs = std::min(mine.size(), theirs.size());
+                long maxSkew = 0;
+                size_t mismatches = 0;
+                for (size_t i = 0; i < pairs; ++i) {
+                    long skew = labs(static_cast<long>(mine[i].at) - static_cast<long>(theirs[i].at));
+                    maxSkew = std::max(maxSkew, skew);
+                    if (mine[i].sequence != theirs[i].sequence) ++mismatches;
+                }
+                printf("%-12d %10zu %10zu %14ld %14zu\n", entry.first, theirs.size(), mine.size(), maxSkew, mismatches);
+                // Heartbeat timing is jittered on every HELLO, so only counts and sequences have to match.
+                if (mine.size() != theirs.size()) ++divergences;
+                divergences += mismatches;
+            }
+            return divergences;
+        }
+    }
+
+    int replay(const char* path, bool realtime) {
+        std::vector<Frame> frames;
+        size_t malformed = 0;
+        if (!load(path, frames, malformed)) {
+            printf("Could not open %s.\n", path);
+            return 2;
+        }
+        size_t received = std::count_if(frames.begin(), frames.end(),
+            [](const Frame& frame) { return frame.kind == Discord::Capture::Kind::Received; });
+        printf("%zu records (%zu frames received), %zu malformed, spanning %.1f s\n", frames.size(), received,
+            malformed, frames.empty() ? 0.0 : frames.back().at / 1000.0);
+        if (frames.empty()) return 2;
+
+        static unsigned long virtualNow = 0;
+        std::vector<SentFrame> sent;
+        sent.reserve(frames.size());
+
+        Discord::Bot bot("REDACTED", 0);
+        // Answer like the application does, so responses take their share of the heap and time.
+        bot.onInteraction([&bot](const char*, const Discord::Interaction&) {
+            Discord::Bot::MessageResponse response;
+            response.content = "Uplink online.";
+            bot.sendCommandResponse(Discord::Bot::InteractionResponse::CHANNEL_MESSAGE_WITH_SOURCE, response);
+            });
+        bot.login();
+        WebSocketsClient* socket = WebSocketsClient::last;
+        // The capacity reserved above keeps this from allocating while the bot is being timed.
+        socket->onSend = [&sent](const char* payload, size_t length) {
+            sent.push_back(decodeSent(virtualNow, payload, length));
+        };
+
+        // Sized up front, so bookkeeping stays out of the heap figures
+        std::map<std::string, std::vector<uint32_t>> latencies;
+        for (const Frame& frame : frames) {
+            if (frame.kind != Discord::Capture::Kind::Received) continue;
+            latencies[frame.op == 0 ? frame.type : std::string(opName(frame.op))].reserve(received);
+        }
+        std::vector<uint32_t> all;
+        all.reserve(received);
+
+        long expectedSequence = bot.lastSequence();
+        std::string expectedSession;
+        size_t stateDivergences = 0;
+
+        Allocations::resetPeak();
+        size_t baseline = Allocations::live();
+        Clock::duration busy {};
+        Clock::time_point start = Clock::now();
+
+        for (size_t i = 0; i < frames.size(); ++i) {
+            Frame& frame = frames[i];
+
+            // Run the bot's clock up to the record, so heartbeats fall due when they did on the device.
+            while (virtualNow < frame.at) {
+                if (realtime) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    virtualNow = std::min<unsigned long>(frame.at,
+                        std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count());
+                }
+                else {
+                    virtualNow = std::min<unsigned long>(frame.at, virtualNow + REPLAY_UPDATE_STEP);
+                }
+                bot.update(virtualNow);
+            }
+
+            switch (frame.kind) {
+                case Discord::Capture::Kind::Connected:
+                    socket->receive(WStype_CONNECTED);
+                    continue;
+                case Discord::Capture::Kind::Disconnected:
+                    socket->receive(WStype_DISCONNECTED);
+                    continue;
+                case Discord::Capture::Kind::Sent:
+                    continue;
+                case Discord::Capture::Kind::Received:
+                    break;
+            }
+
+            Clock::time_point before = Clock::now();
+            socket->receive(WStype_TEXT, reinterpret_cast<uint8_t*>(&frame.payload[0]), frame.payload.size());
+            Clock::duration took = Clock::now() - before;
+            busy += took;
+
+            uint32_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(took).count();
+            all.push_back(ns);
+            latencies[frame.op == 0 ? frame.type : std::string(opName(frame.op))].push_back(ns);
+
+            if (frame.op == 0 && frame.sequence >= 0) expectedSequence = frame.sequence;
+            if (frame.type == "READY") expectedSession = frame.sessionId;
+            if (frame.op == 9 && !frame.resumable) expectedSession.clear();
+
+            bool sequenceMatches = static_cast<long>(bot.lastSequence()) == expectedSequence;
+            bool sessionMatches = expectedSession == bot.sessionId().c_str();
+            if (!sequenceMatches || !sessionMatches) {
+                if (stateDivergences < REPLAY_MAX_REPORTED) {
+                    printf("Diverged at record %zu (%s, %.3f s): sequence %u, capture %ld; session \"%s\", capture \"%s\"\n",
+                        i, frame.op == 0 ? frame.type.c_str() : opName(frame.op), frame.at / 1000.0, bot.lastSequence(),
+                        expectedSequence, bot.sessionId().c_str(), expectedSession.c_str());
+                }
+                ++stateDivergences;
+                // Carry on from the capture's state, so one divergence isn't reported on every later frame.
+                expectedSequence = bot.lastSequence();
+                expectedSession = bot.sessionId().c_str();
+            }
+        }
+
+        double wall = std::chrono::duration<double>(Clock::now() - start).count();
+        double inBot = std::chrono::duration<double>(busy).count();
+        // Let the responder finish, so its allocations are part of the peak.
+        while (bot.inFlightResponses() > 0) std::this_thread::yield();
+
+        printf("\nReplayed in %.3f s of wall time, %.3f s inside the bot: %.0f frames/s\n", wall, inBot,
+            inBot > 0 ? received / inBot : 0.0);
+        printf("Peak heap above baseline: %zu bytes\n\n", Allocations::peak() - baseline);
+
+        printf("%-28s %8s %10s %10s %10s %10s\n", "event", "count", "p50 us", "p90 us", "p99 us", "max us");
+        printLatencies("(all)", all);
+        for (auto& entry : latencies) printLatencies(entry.first.c_str(), entry.second);
+
+        printf("\nReconnects: %u, %u of them resumed; last took %lu ms, slowest %lu ms\n",
+            static_cast<unsigned int>(bot.reconnects()), static_cast<unsigned int>(bot.resumedReconnects()),
+            bot.lastReconnectTime(), bot.maxReconnectTime());
+
+        size_t sentDivergences = compareSent(frames, sent);
+        printf("State divergences: %zu, sent frame divergences: %zu\n", stateDivergences, sentDivergences);
+        return stateDivergences || sentDivergences ? 1 : 0;
+    }
+}
@@ -0,0 +1,33 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef _DISCORD_ESP32A_BENCH_REPLAY_H_
+#define _DISCORD_ESP32A_BENCH_REPLAY_H_
+
+namespace Bench {
+    /// @brief Replays a gateway capture (see capture.h) through Bot::onWebSocketEvents, then reports throughput,
+    /// per-event latency percentiles, peak heap and where the bot's state diverged from the capture.
+    /// @param path Capture file; a raw serial log works too, lines that aren't capture records are skipped.
+    /// @param realtime Keep the capture's original timing instead of replaying as fast as possible.
+    /// @return Process exit code: 0 if the replay matched the capture, 1 if it diverged, 2 if it couldn't run.
+    int replay(const char* path, bool realtime);
+}
+
+#endif //_DISCORD_ESP32A_BENCH_REPLAY_H_
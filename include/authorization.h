@@ -0,0 +1,99 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#ifndef _DISCORD_ESP32A_AUTHORIZATION_H_
+#define _DISCORD_ESP32A_AUTHORIZATION_H_
+
+// Most ids of each kind (users, roles, chats) and most per-command rules the engine holds
+#ifndef AUTHORIZATION_MAX_IDS
+#define AUTHORIZATION_MAX_IDS 32
+#endif
+#ifndef AUTHORIZATION_MAX_RULES
+#define AUTHORIZATION_MAX_RULES 16
+#endif
+
+// Decides who may use which command, on Discord and Telegram alike. Everything is sorted once in begin(), so a
+// check is a few binary searches and never allocates.
+namespace Authorization {
+    // Who a rule lets in; combine with |
+    enum Allow : uint8_t {
+        Nobody = 0,
+        // Discord users listed in Config::users
+        Users = 1 << 0,
+        // Discord members holding any role listed in Config::roles
+        Roles = 1 << 1,
+        // Telegram chats listed in Config::telegramChats
+        TelegramChats = 1 << 2,
+        Everyone = 0xFF
+    };
+
+    struct Rule {
+        // Command name, without the leading /
+        const char* command;
+        uint8_t allow;
+    };
+
+    struct Config {
+        const uint64_t* users = nullptr;
+        size_t usersLength = 0;
+        const uint64_t* roles = nullptr;
+        size_t rolesLength = 0;
+        // Chat ids as strings, as Telegram config usually has them; empty or invalid entries are skipped
+        const char* const* telegramChats = nullptr;
+        size_t telegramChatsLength = 0;
+        const Rule* rules = nullptr;
+        size_t rulesLength = 0;
+        // For commands without a rule
+        uint8_t defaultAllow = Everyone;
+    };
+
+    class Engine {
+    public:
+        /// @brief Copies and sorts the ids and rules. Call once from setup(); the engine keeps no pointers into config
+        /// other than the rules' command names.
+        void begin(const Config& config);
+
+        /// @brief Whether a Discord user may use a command.
+        /// @param roles The member's role ids (member.roles), as Discord sends them. Null in DMs.
+        bool allowsDiscord(const char* command, uint64_t userId, JsonArrayConst roles = JsonArrayConst()) const;
+
+        /// @brief Whether a Telegram chat may use a command.
+        bool allowsTelegram(const char* command, const char* chatId) const;
+
+        // Logs how many ids and rules are in use
+        void report() const;
+
+    private:
+        uint8_t policy(const char* command) const;
+
+        uint64_t _users[AUTHORIZATION_MAX_IDS];
+        size_t _usersLength = 0;
+        uint64_t _roles[AUTHORIZATION_MAX_IDS];
+        size_t _rolesLength = 0;
+        int64_t _chats[AUTHORIZATION_MAX_IDS];
+        size_t _chatsLength = 0;
+        Rule _rules[AUTHORIZATION_MAX_RULES];
+        size_t _rulesLength = 0;
+        uint8_t _defaultAllow = Everyone;
+    };
+}
+
+#endif //_DISCORD_ESP32A_AUTHORIZATION_H_
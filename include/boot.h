@@ -0,0 +1,59 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#ifndef _DISCORD_ESP32A_BOOT_H_
+#define _DISCORD_ESP32A_BOOT_H_
+
+// Tracks how long it takes from power-on until the bot can answer its first command.
+namespace Boot {
+    enum class Phase : uint8_t {
+        // Associated and given an address
+        WiFi,
+        // Every host passed to resolveHosts() has been looked up
+        DNS,
+        // First TLS connection to Discord's REST API is open
+        TLS,
+        // Gateway HELLO received
+        Hello,
+        // Gateway READY or RESUMED received, commands can be answered
+        Ready,
+        COUNT
+    };
+
+    /// @brief Records the time a phase completed. Only the first call for each phase counts.
+    void mark(Phase phase);
+
+    /// @brief Milliseconds from power-on to the end of the phase, or 0 if it has not completed yet.
+    unsigned long elapsed(Phase phase);
+
+    /// @brief Whether every phase has completed.
+    bool complete();
+
+    /// @brief Looks up each host in its own task so the results land in the DNS cache in parallel,
+    /// marking Phase::DNS once all of them have finished.
+    /// @param hosts Host names, which must outlive the lookups.
+    /// @param count Number of hosts.
+    void resolveHosts(const char* const* hosts, size_t count);
+
+    /// @brief Logs every phase's completion time and its duration since the previous phase.
+    void report();
+}
+
+#endif //_DISCORD_ESP32A_BOOT_H_
@@ -0,0 +1,65 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <Arduino.h>
+
+#ifndef _DISCORD_ESP32A_CAPTURE_H_
+#define _DISCORD_ESP32A_CAPTURE_H_
+
+// Marks capture records in a serial log, so they can be picked out of the bot's other output
+#define DISCORD_CAPTURE_PREFIX "[CAPTURE] "
+
+/// @brief Gateway capture records: one line per frame or connection change, replayed on the host by bench/replay.cpp.
+///
+///     [CAPTURE] <ms since previous record> <kind> <payload>
+///
+/// Kind is R for a frame received, S for a frame sent, C for connected and D for disconnected; only R and S carry a
+/// payload, the frame's JSON as it went over the socket. The value of every "token" key is redacted, so captures
+/// can be shared without leaking the bot token or live interaction tokens.
+namespace Discord::Capture {
+    enum class Kind : char {
+        Received = 'R',
+        Sent = 'S',
+        Connected = 'C',
+        Disconnected = 'D'
+    };
+
+    struct Record {
+        unsigned long delta;
+        Kind kind;
+        // Points into the parsed line
+        const char* payload;
+        size_t length;
+    };
+
+    /// @brief Writes one record.
+    /// @param out Where the record goes, usually Serial.
+    /// @param delta Milliseconds since the previous record.
+    /// @param kind What happened.
+    /// @param payload Frame text for Received and Sent, otherwise nullptr. Must not contain a newline.
+    /// @param length Length of payload.
+    void write(Print& out, unsigned long delta, Kind kind, const char* payload = nullptr, size_t length = 0);
+
+    /// @brief Parses one line, with or without the prefix and trailing newline.
+    /// @return False if the line is not a capture record.
+    bool parse(const char* line, size_t length, Record& record);
+}
+
+#endif //_DISCORD_ESP32A_CAPTURE_H_
@@ -0,0 +1,53 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#ifndef _DISCORD_ESP32A_COMPLETION_H_
+#define _DISCORD_ESP32A_COMPLETION_H_
+
+// Most values a CompletionIndex holds
+#ifndef DISCORD_COMPLETION_VALUES
+#define DISCORD_COMPLETION_VALUES 32
+#endif
+// Discord shows at most this many autocomplete choices, each at most 100 characters long
+#define DISCORD_AUTOCOMPLETE_CHOICES 25
+#define DISCORD_AUTOCOMPLETE_CHOICE_SIZE 100
+
+namespace Discord {
+    /// @brief Values to suggest for an autocomplete option. They are sorted once in begin(), so each keystroke
+    /// costs a binary search and a short scan, with nothing allocated.
+    class CompletionIndex {
+    public:
+        /// @brief Sorts the values, ignoring case. The strings are not copied, so they must outlive the index.
+        /// Values too long for a choice, or holding quotes or backslashes, are left out so they can be sent unescaped.
+        void begin(const char* const* values, size_t length);
+
+        /// @brief Fills out with the values starting with prefix, ignoring case, in alphabetical order.
+        /// @return How many were written, at most capacity.
+        size_t complete(const char* prefix, const char** out, size_t capacity) const;
+
+        size_t size() const { return _length; }
+
+    private:
+        const char* _values[DISCORD_COMPLETION_VALUES];
+        uint8_t _length = 0;
+    };
+}
+
+#endif //_DISCORD_ESP32A_COMPLETION_H_
@@ -0,0 +1,108 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+#include <atomic>
+
+#ifndef _DISCORD_ESP32A_CONNECTIONCACHE_H_
+#define _DISCORD_ESP32A_CONNECTIONCACHE_H_
+
+// Hosts that can hold an open TLS connection at once. Each costs the TLS buffers (~40KB of heap) while open.
+#ifndef DISCORD_CONNECTION_CACHE_SIZE
+#define DISCORD_CONNECTION_CACHE_SIZE 2
+#endif
+
+namespace Discord {
+    /// @brief Keeps one TLS connection open per host, so requests after the first skip the handshake.
+    /// The Arduino TLS client does not expose mbedTLS session tickets, so instead of resuming sessions this
+    /// resumes connections: a lease hands out the host's HTTPClient, still connected if the server kept it alive.
+    class ConnectionCache {
+    public:
+        /// @brief Exclusive use of one host's HTTPClient until destroyed. The client is already pointed at the host:
+        /// pass paths rather than full URLs to setURL() or sendRest(), since a full URL drops the connection,
+        /// and never call end() on it.
+        class Lease {
+        public:
+            Lease(Lease&& other);
+            Lease(const Lease&) = delete;
+            Lease& operator=(const Lease&) = delete;
+            ~Lease();
+
+            HTTPClient& http();
+            // Whether the connection was still open, so no handshake is needed
+            bool reused() const { return _reused; }
+            // False if acquire() gave up waiting; http() must not be used then
+            explicit operator bool() const { return _cache != nullptr; }
+
+        private:
+            friend class ConnectionCache;
+            Lease(ConnectionCache* cache, size_t index, bool reused);
+
+            ConnectionCache* _cache;
+            size_t _index;
+            bool _reused;
+        };
+
+        ConnectionCache();
+
+        /// @brief Takes the cached connection for a host, waiting if another task is using it.
+        /// If every slot belongs to another host, the least recently used idle connection is closed to make room.
+        /// @param secure Whether to use TLS; plain connections are only for local stand-ins like the simulator.
+        /// @param wait Ticks to wait for another task's lease; the lease returned is empty if that runs out.
+        Lease acquire(const char* host, uint16_t port = 443, bool secure = true, TickType_t wait = portMAX_DELAY);
+
+        /// @brief Closes connections that have not been used for idleTimeout milliseconds, returning their heap.
+        void expire(unsigned long idleTimeout);
+
+        // Leases that found the connection still open
+        uint32_t hits() const { return _hits.load(); }
+        // Leases that needed a new handshake
+        uint32_t misses() const { return _misses.load(); }
+
+        void logStats() const;
+
+    private:
+        struct Entry {
+            char host[64] = "";
+            uint16_t port = 0;
+            bool secure = true;
+            WiFiClientSecure secureClient;
+            WiFiClient plainClient;
+            HTTPClient http;
+
+            WiFiClient& client() { return secure ? secureClient : plainClient; }
+            SemaphoreHandle_t mtx = nullptr;
+            unsigned long lastUsed = 0;
+        };
+
+        void release(size_t index);
+
+        Entry _entries[DISCORD_CONNECTION_CACHE_SIZE];
+        // Guards the host/port assignment of the entries, not the connections themselves
+        SemaphoreHandle_t _tableMtx;
+        std::atomic<uint32_t> _hits { 0 };
+        std::atomic<uint32_t> _misses { 0 };
+    };
+
+    // Shared by every REST caller, Bot included, so each host costs one TLS session at most
+    extern ConnectionCache connectionCache;
+}
+
+#endif //_DISCORD_ESP32A_CONNECTIONCACHE_H_
@@ -21,15 +21,183 @@
 #include <ArduinoJson.h>
 #include <HTTPClient.h>
 #include <WebSocketsClient.h>
+#include <atomic>
+#include <bitset>
+#include <initializer_list>
+
+#include <capture.h>
+#include <completion.h>
+#include <interaction.h>
+#include <interactions.h>
+#include <eventring.h>
+#include <textcommands.h>
 
 #ifndef _DISCORD_ESP32A_H_
 #define _DISCORD_ESP32A_H_
 
+// Where the REST API and gateway are. Override them all to point the bot at a local stand-in such as
+// tools/discord_sim.py, see the esp32dev-sim environment.
+#ifndef DISCORD_HOST
 #define DISCORD_HOST "https://discord.com"
+#endif
+// DISCORD_HOST without the scheme or port, used to key cached connections
+#ifndef DISCORD_API_HOSTNAME
+#define DISCORD_API_HOSTNAME "discord.com"
+#endif
+#ifndef DISCORD_API_PORT
+#define DISCORD_API_PORT 443
+#endif
+// Whether DISCORD_HOST is https
+#ifndef DISCORD_API_SECURE
+#define DISCORD_API_SECURE 1
+#endif
+#ifndef DISCORD_API_URI
 #define DISCORD_API_URI "/api/v10"
+#endif
+// The gateway host comes from Get Gateway; only the port and whether it is wss are fixed here
+#ifndef DISCORD_GATEWAY_PORT
+#define DISCORD_GATEWAY_PORT 443
+#endif
+#ifndef DISCORD_GATEWAY_SECURE
+#define DISCORD_GATEWAY_SECURE 1
+#endif
 #define DISCORD_GATEWAY_SUFFIX "/?v=10&encoding=json"
 
+// Reconnect backoff: the delay ceiling doubles from the base after each failed attempt, up to the max, and the
+// actual delay is picked at random from the upper half of it so a fleet dropped at once doesn't return in step.
+#ifndef DISCORD_RECONNECT_BASE_DELAY
+#define DISCORD_RECONNECT_BASE_DELAY 1000
+#endif
+#ifndef DISCORD_RECONNECT_MAX_DELAY
+#define DISCORD_RECONNECT_MAX_DELAY 60000
+#endif
+// An attempt that hasn't reached READY or RESUMED by then is abandoned
+#ifndef DISCORD_HANDSHAKE_TIMEOUT
+#define DISCORD_HANDSHAKE_TIMEOUT 15000
+#endif
+// Failed resumes in a row before the session is given up and the next attempt identifies
+#ifndef DISCORD_RESUME_ATTEMPTS
+#define DISCORD_RESUME_ATTEMPTS 3
+#endif
+// A heartbeat not acknowledged within smoothed RTT + 4 * RTT variance marks the connection dead. This is the
+// window before the first RTT sample, and the least it can shrink to; it never exceeds the heartbeat interval.
+// The floor leaves room for Wi-Fi power save and for frames queued ahead of the ACK, which the RTT doesn't show.
+#ifndef DISCORD_ACK_TIMEOUT_INITIAL
+#define DISCORD_ACK_TIMEOUT_INITIAL 5000
+#endif
+#ifndef DISCORD_ACK_TIMEOUT_MIN
+#define DISCORD_ACK_TIMEOUT_MIN 3000
+#endif
+// Heartbeats tracked while waiting for their ACK; Discord may ask for extra ones with op 1
+#ifndef DISCORD_HEARTBEATS_OUTSTANDING
+#define DISCORD_HEARTBEATS_OUTSTANDING 4
+#endif
+// Command responses that can be queued at once. Each slot holds a preallocated URI and JSON body.
+#ifndef DISCORD_RESPONSE_SLOTS
+#define DISCORD_RESPONSE_SLOTS 4
+#endif
+#ifndef DISCORD_RESPONSE_JSON_SIZE
+#define DISCORD_RESPONSE_JSON_SIZE 1024
+#endif
+// The last slots, which only busy responses may use, so turning an interaction away never fails for lack of a slot
+#ifndef DISCORD_RESPONSE_RESERVED_SLOTS
+#define DISCORD_RESPONSE_RESERVED_SLOTS 1
+#endif
+// Interactions are turned away while the largest free heap block is smaller than this, in bytes
+#ifndef DISCORD_ADMISSION_MIN_HEAP
+#define DISCORD_ADMISSION_MIN_HEAP (16 * 1024)
+#endif
+// Sent instead of running the handler for an interaction that was turned away. Ephemeral, so only its user sees it.
+#ifndef DISCORD_BUSY_RESPONSE
+#define DISCORD_BUSY_RESPONSE \
+    "{\"type\":4,\"data\":{\"content\":\"The bot is busy right now, please try again in a moment.\",\"flags\":64}}"
+#endif
+// Room for the interaction a text command is turned into; its strings point into the message, so this only holds
+// the structure
+#ifndef DISCORD_TEXT_COMMAND_JSON_SIZE
+#define DISCORD_TEXT_COMMAND_JSON_SIZE 768
+#endif
+// Command options Bot::addAutocomplete() can serve
+#ifndef DISCORD_AUTOCOMPLETE_SOURCES
+#define DISCORD_AUTOCOMPLETE_SOURCES 4
+#endif
+// Room for a response built from a MessageResponse, buttons included
+#ifndef DISCORD_MESSAGE_JSON_SIZE
+#define DISCORD_MESSAGE_JSON_SIZE 768
+#endif
+// Discord allows at most 5 buttons in a row; responses only get one row
+#define DISCORD_MESSAGE_BUTTONS 5
+// Interaction tokens are a few hundred characters long
+#define DISCORD_INTERACTION_TOKEN_SIZE 384
+#define DISCORD_RESPONSE_URI_SIZE (DISCORD_INTERACTION_TOKEN_SIZE + 64)
+// Largest control frame (identify, resume, heartbeat, presence) formatted in place for the gateway
+#define DISCORD_TX_PAYLOAD_SIZE 384
+// Discord closes the connection past this many gateway events sent per minute
+#define DISCORD_GATEWAY_RATE_LIMIT 120
+// Presence updates sent per minute at most, so heartbeats, identify and resume always fit in what is left
+#ifndef DISCORD_PRESENCE_BUDGET
+#define DISCORD_PRESENCE_BUDGET 10
+#endif
+// A presence must stay unchanged this long before it is sent, in ms; changes in between replace it
+#ifndef DISCORD_PRESENCE_DEBOUNCE
+#define DISCORD_PRESENCE_DEBOUNCE 2000
+#endif
+// Minimum time between presence updates, in ms
+#ifndef DISCORD_PRESENCE_INTERVAL
+#define DISCORD_PRESENCE_INTERVAL 15000
+#endif
+// Longest activity text, after JSON escaping
+#define DISCORD_PRESENCE_TEXT_SIZE 128
+// How long the gateway URL cached in NVS is trusted for, in seconds
+#ifndef DISCORD_GATEWAY_CACHE_TTL
+#define DISCORD_GATEWAY_CACHE_TTL (24UL * 60UL * 60UL)
+#endif
+// How long a session saved by saveResumeState() is worth resuming after the restart, in seconds
+#ifndef DISCORD_RESUME_STATE_MAX_AGE
+#define DISCORD_RESUME_STATE_MAX_AGE 60
+#endif
+// Events waiting for the worker task, must be a power of two
+#ifndef DISCORD_EVENT_RING_SIZE
+#define DISCORD_EVENT_RING_SIZE 8
+#endif
+// What happens to a new event when the ring is full, see Discord::RingPolicy
+#ifndef DISCORD_EVENT_RING_POLICY
+#define DISCORD_EVENT_RING_POLICY Discord::RingPolicy::Reject
+#endif
+
+static_assert(DISCORD_RESPONSE_RESERVED_SLOTS < DISCORD_RESPONSE_SLOTS, "Some response slots must be left for handlers");
+static_assert(DISCORD_PRESENCE_BUDGET < DISCORD_GATEWAY_RATE_LIMIT / 2, "Presence must leave most of the rate limit to control frames");
+
 namespace Discord {
+    // Gateway intents: which groups of events Discord sends. Combine with |.
+    namespace Intents {
+        constexpr unsigned int GUILDS = 1 << 0;
+        // Privileged
+        constexpr unsigned int GUILD_MEMBERS = 1 << 1;
+        constexpr unsigned int GUILD_MODERATION = 1 << 2;
+        constexpr unsigned int GUILD_EMOJIS_AND_STICKERS = 1 << 3;
+        constexpr unsigned int GUILD_INTEGRATIONS = 1 << 4;
+        constexpr unsigned int GUILD_WEBHOOKS = 1 << 5;
+        constexpr unsigned int GUILD_INVITES = 1 << 6;
+        constexpr unsigned int GUILD_VOICE_STATES = 1 << 7;
+        // Privileged
+        constexpr unsigned int GUILD_PRESENCES = 1 << 8;
+        constexpr unsigned int GUILD_MESSAGES = 1 << 9;
+        constexpr unsigned int GUILD_MESSAGE_REACTIONS = 1 << 10;
+        constexpr unsigned int GUILD_MESSAGE_TYPING = 1 << 11;
+        constexpr unsigned int DIRECT_MESSAGES = 1 << 12;
+        constexpr unsigned int DIRECT_MESSAGE_REACTIONS = 1 << 13;
+        constexpr unsigned int DIRECT_MESSAGE_TYPING = 1 << 14;
+        // Privileged. Message text outside DMs and mentions; it doesn't deliver any events by itself.
+        constexpr unsigned int MESSAGE_CONTENT = 1 << 15;
+        constexpr unsigned int GUILD_SCHEDULED_EVENTS = 1 << 16;
+        constexpr unsigned int AUTO_MODERATION_CONFIGURATION = 1 << 20;
+        constexpr unsigned int AUTO_MODERATION_EXECUTION = 1 << 21;
+
+        // Not an intent: identify with the least the subscribed events and features need
+        constexpr unsigned int AUTOMATIC = ~0u;
+    }
+
     class Bot {
     public:
         enum class Event {
@@ -134,85 +302,27 @@ namespace Discord {
             MODAL
         };
 
-        // struct User {
-        //     enum class PremiumType {
-        //         NONE,
-        //         NITRO_CLASSIC,
-        //         NITRO,
-        //         NITRO_BASIC
-        //     };
-
-        //     uint64_t id = 0;
-        //     const char* username = "";
-        //     uint16_t discriminator = 0;
-        //     const char* globalName = "";
-        //     const char* avatarHash = "";
-        //     bool bot = false;
-        //     bool system = false;
-        //     bool mfaEnabled = false;
-        //     const char* bannerHash = "";
-        //     int accentColor = 0;
-        //     const char* locale = "";
-        //     bool verified = false;
-        //     const char* email = "";
-        //     uint32_t flags = 0;
-        //     PremiumType premiumType = PremiumType::NONE;
-        //     uint32_t publicFlags = 0;
-        //     const char* avatarDecoHash = "";
-        // };
-
-        // struct Member {
-        //     const char* nick = "";
-        //     const char* avatarHash = "";
-        //     std::vector<uint64_t> roles;
-        //     //TODO: joined_at, premium_since
-        //     bool deaf = false;
-        //     bool mute = false;
-        //     uint32_t flags = 0;
-        //     bool pending = false;
-        //     uint64_t permissions = 0;
-        //     //TODO: communication_disabled_until?
-        // };
-
-        // struct Interaction {
-        //     enum class Type {
-        //         INVALID,
-        //         PING = 1,
-        //         APPLICATION_COMMAND,
-        //         MESSAGE_COMPONENT,
-        //         APPLICATION_COMMAND_AUTOCOMPLETE,
-        //         MODAL_SUBMIT
-        //     };
-
-        //     struct Data {
-        //         uint64_t commandId = 0;
-        //         const char* name = "";
-        //         CommandType type = CommandType::INVALID;
-        //         // TODO: resolved?, options?
-        //         uint64_t guildId = 0;
-        //         uint64_t targetId = 0;
-        //     };
-
-        //     uint64_t id = 0;
-        //     uint64_t applicationId = 0;
-        //     Type type = Type::INVALID;
-        //     Data data;
-        //     uint64_t guildId = 0;
-        //     // TODO: channel?
-        //     uint64_t channelId = 0;
-        //     Member member;
-        //     User user;
-        //     uint8_t version = 1;
-        //     // TODO: message?
-        //     uint64_t permissions = 0;
-        //     const char* locale = "";
-        //     // Not available for PING interactions
-        //     const char* guildLocale = "";
-        // };
-
-        typedef std::function<void(Event type, const StaticJsonDocument<1024>& json)> EventCallback;
-        typedef std::function<void(const char* name, const JsonObject& interaction)> InteractionCallback;
-        //typedef std::function<void(const char* name, const Interaction& interaction)> InteractionCallback;
+        enum class Status {
+            ONLINE,
+            IDLE,
+            DO_NOT_DISTURB,
+            // Shown as offline, but still connected
+            INVISIBLE
+        };
+
+        enum class ActivityType {
+            NONE = -1,
+            PLAYING,
+            STREAMING,
+            LISTENING,
+            WATCHING,
+            // Shows the text as it is, without a "Playing"-style prefix
+            CUSTOM,
+            COMPETING
+        };
+
+        typedef std::function<void(Event type, const JsonDocument& json)> EventCallback;
+        typedef std::function<void(const char* name, const Interaction& interaction)> InteractionCallback;
 
         struct MessageResponse {
             enum class Flags : char {
@@ -221,51 +331,293 @@ namespace Discord {
                 EPHEMERAL = 1 << 6,
             };
 
+            struct Button {
+                enum class Style : uint8_t {
+                    PRIMARY = 1,
+                    SECONDARY,
+                    SUCCESS,
+                    DANGER
+                };
+
+                const char* label;
+                // Comes back as the name of the MESSAGE_COMPONENT interaction when the button is pressed
+                const char* customId;
+                Style style;
+                bool disabled;
+            };
+
             bool tts = false;
-            String content = "";
+            // Only read while sendCommandResponse() runs, so it may point into a temporary buffer
+            const char* content = "";
+            // A row of up to DISCORD_MESSAGE_BUTTONS buttons; like content, only read while the response is sent.
+            // UPDATE_MESSAGE replaces the row, so pass the buttons again to keep them.
+            const Button* buttons = nullptr;
+            size_t buttonsLength = 0;
             // TODO: array of embed objects, 
             // allowed_mentions object, 
-            // array of components, 
             // array of partial attachments
             Flags flags = Flags::NONE;
         };
 
         Bot(const char* botToken, uint64_t applicationId, bool rateLimit = true);
 
-        void login(unsigned int intents = 0);
+        /// @param intents Gateway intents to identify with, see begin().
+        void login(unsigned int intents = Intents::AUTOMATIC);
+
+        /// @brief Runs the gateway connection (login, socket and heartbeat) in a task pinned to gatewayCore, and
+        /// interaction callbacks in a worker task pinned to workerCore. Do not call login() or update() afterwards.
+        /// @param intents Gateway intents to identify with. Intents::AUTOMATIC works them out from onEvent() and
+        /// requireIntents(); anything else is used with requireIntents() added, and a warning for subscribed events
+        /// it won't deliver.
+        /// @param gatewayCore Core for the WebSocket task, 0 keeps it alongside the Wi-Fi stack.
+        /// @param workerCore Core for the interaction worker, 1 is shared with the Arduino loop.
+        /// @return Whether both tasks were started.
+        bool begin(unsigned int intents = Intents::AUTOMATIC, BaseType_t gatewayCore = 0, BaseType_t workerCore = 1);
 
         void update(unsigned long now);
 
+        /// @brief Opens the REST connection to Discord ahead of the first command response, refreshing the cached
+        /// gateway URL on the way. Blocks for the TLS handshake, so run it from a task of its own during startup.
+        /// @return Whether the request succeeded.
+        bool warmUp();
+
         void logout();
 
+        /// @brief Keeps the session id, sequence and resume URL in RTC memory across a software restart, so the
+        /// next login() resumes the session instead of identifying. Call right before ESP.restart(); safe to call
+        /// from any task.
+        /// @return Whether there was a session to save.
+        bool saveResumeState();
+
+        /// @brief Passes every gateway event to cb. Adds no intents, so only events the intents given to begin()
+        /// deliver arrive; prefer subscribing to the events you need.
         void onEvent(const EventCallback& cb);
+        /// @brief Passes only the listed events to cb, and adds the intents that deliver them. Call before begin().
+        void onEvent(const EventCallback& cb, std::initializer_list<Event> events);
+        /// @brief Adds intents a feature needs on top of its events, such as Intents::MESSAGE_CONTENT for the
+        /// text of guild messages. Added to explicit intents given to begin() or login() too. Call before begin().
+        void requireIntents(unsigned int intents) { _requiredIntents |= intents; }
+        /// @brief Intents the subscribed events and features need.
+        unsigned int requiredIntents() const;
+        // Intents sent with the last identify
+        unsigned int intents() const { return _intents; }
         void onInteraction(const InteractionCallback& cb);
 
-        void sendCommandResponse(const InteractionResponse& type, const StaticJsonDocument<512>& response);
+        /// @brief Also answers messages that start with prefix and a command's name, such as "!wake pc", by calling
+        /// the interaction callback as if the slash command had been used. Arguments fill the command's options in
+        /// order, and sendCommandResponse() replies to the message in its channel. Adds the DIRECT_MESSAGES intent;
+        /// guild messages need GUILD_MESSAGES and the privileged MESSAGE_CONTENT as well. Call before begin().
+        /// @param prefix Not copied, so it must outlive the bot.
+        /// @param commands The command table, also not copied.
+        void setTextCommands(const char* prefix, const Interactions::ApplicationCommand* commands, size_t length);
+
+        /// @brief Answers autocomplete for an option with the values in index that start with what has been typed.
+        /// Autocomplete comes on every keystroke, so it is answered straight from the gateway task, without the
+        /// worker or the interaction callback. Mark the option with autocomplete = true when registering it.
+        /// @param command,option Names, not copied.
+        /// @param index Not copied, so it must outlive the bot.
+        /// @return Whether there was room, see DISCORD_AUTOCOMPLETE_SOURCES.
+        bool addAutocomplete(const char* command, const char* option, const CompletionIndex& index);
+
+        /// @brief Writes every gateway frame received or sent, and every connection change, to out as capture
+        /// records (see capture.h) for replaying on the host. Tokens are redacted. Frames can be tens of KB, so
+        /// only point this at something that keeps up, like Serial at a high baud rate.
+        /// @param out Where to write, or nullptr to stop capturing.
+        void captureTo(Print* out);
+
+        void sendCommandResponse(const InteractionResponse& type, const JsonDocument& response);
+        /// @brief Responds to the interaction being handled. For a button press, UPDATE_MESSAGE edits the message
+        /// holding the button instead of sending a new one, and DEFERRED_UPDATE_MESSAGE acknowledges it for
+        /// editOriginalResponse() to edit later.
         void sendCommandResponse(const InteractionResponse& type, const MessageResponse& response);
-
-        //void updatePresence();
+        /// @brief Edits the message the interaction being handled responded with, or the message holding the
+        /// button after DEFERRED_UPDATE_MESSAGE. For work that takes longer than Discord waits for a response:
+        /// acknowledge with a deferred response first, then edit. Does nothing for text commands. Admission only
+        /// promises an interaction a slot for its first response, so the edit is dropped if no spare slot is free.
+        void editOriginalResponse(const MessageResponse& response);
+
+        /// @brief Sets the bot's presence. Safe to call from any task, as often as you like: only the latest
+        /// presence is sent, once it has been stable for DISCORD_PRESENCE_DEBOUNCE, at most once every
+        /// DISCORD_PRESENCE_INTERVAL and DISCORD_PRESENCE_BUDGET times a minute. It is sent again after each new
+        /// session, and setting the presence already shown sends nothing.
+        /// @param activity Text for the activity; copied, so it may be a temporary.
+        void setPresence(Status status, ActivityType type = ActivityType::NONE, const char* activity = nullptr);
+
+        // Presence changes replaced by a later one before they were sent
+        uint32_t coalescedPresenceUpdates() const { return _presenceCoalesced; }
 
         bool online() { return _online; }
 
+        enum class ConnectionState : uint8_t {
+            // Waiting out the backoff before the next attempt
+            DISCONNECTED,
+            // Opening the socket, or waiting for HELLO
+            CONNECTING,
+            // Resume sent, waiting for RESUMED
+            RESUMING,
+            // Identify sent, waiting for READY
+            IDENTIFYING,
+            READY
+        };
+        ConnectionState connectionState() const { return _state; }
+        // Connections that were lost after READY and came back, and how many of those resumed their session
+        uint32_t reconnects() const { return _reconnects; }
+        uint32_t resumedReconnects() const { return _resumedReconnects; }
+        // Time from losing the connection to READY or RESUMED, in ms, for the last and the slowest reconnect
+        unsigned long lastReconnectTime() const { return _lastReconnectTime; }
+        unsigned long maxReconnectTime() const { return _maxReconnectTime; }
+
+        // Events waiting for the worker task
+        size_t pendingEvents() const { return _events.size(); }
+        // Highest number of events that were waiting at once
+        size_t peakPendingEvents() const { return _events.highWater(); }
+        // Events rejected or evicted because the worker fell behind
+        uint32_t droppedEvents() const { return _events.dropped(); }
+        // Autocomplete interactions answered
+        uint32_t autocompleteAnswered() const { return _autocompleteAnswered; }
+        // Interactions answered with DISCORD_BUSY_RESPONSE, or not at all, because there was no capacity for them
+        uint32_t shedInteractions() const { return _shedInteractions.load(); }
+        // Command responses queued or being sent
+        unsigned int inFlightResponses() const {
+            return _freeResponseSlots ? DISCORD_RESPONSE_SLOTS - uxQueueMessagesWaiting(_freeResponseSlots)
+                - uxQueueMessagesWaiting(_reservedResponseSlots) : 0;
+        }
+        // When the interaction callback last finished, 0 if it hasn't run yet
+        unsigned long lastInteractionAt() const { return _lastInteractionAt; }
+        // How long the interaction callback took for the interaction that finished at lastInteractionAt(), in ms
+        unsigned long lastHandlerDuration() const { return _lastHandlerDuration; }
+        // Interactions and text commands admitted whose handler hasn't finished yet
+        unsigned int activeInteractions() const { return _admittedInteractions.load(); }
+        unsigned long lastHeartbeatAck() const { return _lastHeartbeatAck; }
+        unsigned int lastSequence() const { return _lastSocketSequence; }
+        const String& sessionId() const { return _sessionId; }
+        unsigned long heartbeatInterval() const { return _heartbeatInterval; }
+        // Smoothed heartbeat round trip time and its variance, in ms; 0 until the first ACK
+        unsigned long heartbeatRtt() const { return _srtt; }
+        unsigned long heartbeatRttVariance() const { return _rttvar; }
+        // How long a heartbeat may go unacknowledged before the connection is resumed, in ms
+        unsigned long ackTimeout() const;
+        // Connections resumed because a heartbeat went unacknowledged
+        uint32_t zombieConnections() const { return _zombieConnections; }
+
         uint64_t applicationId() { return _applicationId; }
     private:
+        // A serialized command response waiting for the responder task. Reused, never allocated per response.
+        struct ResponseSlot {
+            // POST for interaction callbacks and messages, PATCH for edits
+            const char* method;
+            char uri[DISCORD_RESPONSE_URI_SIZE];
+            char json[DISCORD_RESPONSE_JSON_SIZE];
+            // What gets sent: json, or a constant response such as DISCORD_BUSY_RESPONSE
+            const char* body;
+            size_t bodyLength;
+            unsigned long queuedAt;
+        };
+
+        // A parsed gateway frame handed from the gateway task to the worker task
+        struct GatewayEvent {
+            Event type;
+            unsigned int sequence;
+            unsigned long receivedAt;
+            // Owned by whoever holds the record; deleted once handled or dropped
+            DynamicJsonDocument* frame;
+        };
+
+        // Intents that deliver type, any one of them will do; 0 if it needs none
+        static unsigned int intentsFor(Event type);
+        // The Event for a dispatch name, or Event::Dispatch if there isn't one
+        static Event dispatchEvent(const char* name);
+        // Settles which intents to identify with, warning about subscriptions they won't deliver
+        unsigned int resolveIntents(unsigned int intents);
+        // Hands the frame to the event callback if type is subscribed
+        void notify(Event type, const JsonDocument& json) {
+            if (_outerCallback && _subscribedEvents[static_cast<size_t>(type)]) _outerCallback(type, json);
+        }
+
         void onWebSocketEvents(WStype_t type, uint8_t* payload, size_t length);
         void parseMessage(uint8_t* payload, size_t length);
+        void handleInteraction(const JsonObject& interaction);
+        // Writes the fields of a message: content, flags and buttons
+        static void serializeMessage(const MessageResponse& response, JsonObject data);
+        // Answers an autocomplete interaction from the matching index, if a response slot is free
+        void handleAutocomplete(const JsonObject& interaction);
+        // Whether a MESSAGE_CREATE payload is a text command from someone other than a bot
+        bool isTextCommand(JsonObjectConst message) const;
+        void handleTextCommand(const JsonObject& message);
+        // Calls the interaction callback, timing and tracing it
+        void runCallback(const char* name, const Interaction& interaction);
+        // Hands an admitted interaction or text command to the worker task, or handles it here without one
+        void enqueue(Event type, DynamicJsonDocument& doc);
+        // Gives up on an admitted event the worker never got to
+        void drop(GatewayEvent& event);
+        // Whether there is a response slot and enough heap to handle one more interaction; if so, it is counted
+        // as admitted, and a slot promised to its response, until retire().
+        bool admit();
+        // Ends the running handler's admission, giving back its promised slot if it never responded
+        void retire();
+        // Answers an interaction with DISCORD_BUSY_RESPONSE from a reserved slot, without running the handler.
+        void shed(const JsonObject& interaction);
+        // Counts one more unreserved slot as taken, if there is one that isn't already taken or promised
+        bool commitResponseSlot();
+        // Takes an unreserved slot for the running handler: the promised one for its first response, a spare
+        // one after that.
+        bool takeResponseSlot(uint8_t& index);
+        // Returns a sent or abandoned slot to the queue it came from
+        void releaseResponseSlot(uint8_t index);
+
+        static void gatewayTask(void* parameter);
+        static void interactionTask(void* parameter);
+        static void responseTask(void* parameter);
+        bool startResponder();
 
         void heartbeat();
         void identify();
         void resume();
 
+        // Closes the socket and schedules the next attempt. A resumable loss keeps the session for a resume,
+        // unless resumes have already failed DISCORD_RESUME_ATTEMPTS times in a row.
+        void connectionLost(const char* reason, bool resumable);
+        // Called on READY or RESUMED
+        void connected(bool resumed);
+        // Backoff before the next attempt, from the failures so far
+        unsigned long reconnectDelay();
+
+        bool restoreResumeState();
+
         bool sendWS(const char* payload, size_t length);
+        // Formats a control frame into _txBuffer's payload area, returning its length or 0 if it didn't fit.
+        size_t formatFrame(const char* format, ...) __attribute__((format(printf, 2, 3)));
+        // Sends the frame in _txBuffer without copying it.
+        bool sendFrame(size_t length);
+        bool withinRateLimit();
+        // Sends the pending presence if it has settled and the budget allows
+        void updatePresence();
+        void capture(Capture::Kind kind, const char* payload = nullptr, size_t length = 0);
 
-        SemaphoreHandle_t _httpsMtx;
-        HTTPClient _https;
         WebSocketsClient _socket;
         EventCallback _outerCallback;
+        std::bitset<128> _subscribedEvents;
+        // Intents added by requireIntents()
+        unsigned int _requiredIntents = 0;
+        // Whether resolveIntents() has run yet, so its warnings aren't repeated on every reconnect
+        bool _intentsResolved = false;
         InteractionCallback _interactionCallback;
 
+        TaskHandle_t _gatewayTask = nullptr;
+        TaskHandle_t _interactionTask = nullptr;
+        // Filled by the gateway task, drained by the worker task
+        EventRing<GatewayEvent, DISCORD_EVENT_RING_SIZE> _events { DISCORD_EVENT_RING_POLICY };
+        unsigned long _nextLoginAttempt = 0;
+
+        // From Get Gateway or NVS, for identifying
         String _gatewayURL;
+        // From READY, for resuming
+        String _resumeURL;
+        // Only touched from the task running update(), which is the only one sending control frames.
+        // The front is left free for the WebSocket header.
+        char _txBuffer[WEBSOCKETS_MAX_HEADER_SIZE + DISCORD_TX_PAYLOAD_SIZE];
+        // Whether _gatewayURL came from NVS, and so should be dropped if it fails to reach HELLO
+        bool _gatewayFromCache = false;
 
         const char* _op = "op";
         const char* _d = "d";
@@ -274,18 +626,85 @@ namespace Discord {
         uint64_t _applicationId; // No initialization here
         unsigned int _intents = 0;
 
-        uint64_t _interactionId;
-        String _interactionToken;
+        uint64_t _interactionId = 0;
+        char _interactionToken[DISCORD_INTERACTION_TOKEN_SIZE] = "";
+        // Set instead of the interaction id and token while a text command's handler runs
+        uint64_t _textChannelId = 0;
+        uint64_t _textMessageId = 0;
+
+        const char* _textPrefix = nullptr;
+        size_t _textPrefixLength = 0;
+        CommandTrie _textCommands;
+
+        struct AutocompleteSource {
+            const char* command;
+            const char* option;
+            const CompletionIndex* index;
+        };
+        AutocompleteSource _autocompleteSources[DISCORD_AUTOCOMPLETE_SOURCES];
+        uint8_t _autocompleteSourcesLength = 0;
+        uint32_t _autocompleteAnswered = 0;
+
+        // "Bot <token>", built once for every request's Authorization header
+        String _authorization;
+        ResponseSlot _responseSlots[DISCORD_RESPONSE_SLOTS];
+        // Indices into _responseSlots that are free, free among the reserved ones, and waiting to be sent
+        QueueHandle_t _freeResponseSlots = nullptr;
+        QueueHandle_t _reservedResponseSlots = nullptr;
+        QueueHandle_t _readyResponseSlots = nullptr;
+        TaskHandle_t _responseTask = nullptr;
+        // Admitted interactions whose handler hasn't finished
+        std::atomic<unsigned int> _admittedInteractions { 0 };
+        // Unreserved slots in flight, plus one promised to each admitted interaction that hasn't responded yet
+        std::atomic<unsigned int> _committedResponseSlots { 0 };
+        // Whether the running handler still has its promised slot; only touched by the task running handlers
+        bool _responseOwed = false;
+        std::atomic<uint32_t> _shedInteractions { 0 };
 
         bool _online = false;
 
-        unsigned long _now;
+        ConnectionState _state = ConnectionState::DISCONNECTED;
+        // When the current attempt started, for DISCORD_HANDSHAKE_TIMEOUT. 0 until update() next runs.
+        unsigned long _attemptStartedAt = 0;
+        // Attempts and resumes that failed since the last READY or RESUMED
+        uint8_t _failedAttempts = 0;
+        uint8_t _failedResumes = 0;
+        // Whether the current attempt is a resume
+        bool _resuming = false;
+        // Set while reconnecting after READY, from when the connection was lost
+        bool _reconnecting = false;
+        unsigned long _outageStartedAt = 0;
+        uint32_t _reconnects = 0;
+        uint32_t _resumedReconnects = 0;
+        unsigned long _lastReconnectTime = 0;
+        unsigned long _maxReconnectTime = 0;
+
+        Print* _capture = nullptr;
+        unsigned long _lastCaptureAt = 0;
+
+        volatile unsigned long _lastInteractionAt = 0;
+        volatile unsigned long _lastHandlerDuration = 0;
+
+        unsigned long _now = 0;
         unsigned long _heartbeatInterval = 0;
         unsigned long _lastHeartbeatAck = 0;
         unsigned long _lastHeartbeatSend = 0;
         unsigned long _firstHeartbeat = 0;
+        // When each heartbeat still waiting for its ACK was sent, oldest first. Discord acknowledges them in order.
+        unsigned long _heartbeatsSentAt[DISCORD_HEARTBEATS_OUTSTANDING];
+        uint8_t _unackedHeartbeats = 0;
+        // ACKs still to come for heartbeats that were dropped from _heartbeatsSentAt to make room
+        uint8_t _untrackedAcks = 0;
+        // Round trip estimate, as in RFC 6298
+        bool _rttMeasured = false;
+        unsigned long _srtt = 0;
+        unsigned long _rttvar = 0;
+        uint32_t _zombieConnections = 0;
 
         bool _ready = false;
+        // Guards _sessionId and _resumeURL, which saveResumeState() copies from other tasks. Only the task running
+        // update() writes them, so it reads them without the lock.
+        SemaphoreHandle_t _sessionMtx;
         String _sessionId;
         // You need to cache the most recent non-null sequence value for heartbeats, and to pass when resuming a connection.
         unsigned int _lastSocketSequence = 0;
@@ -294,6 +713,30 @@ namespace Discord {
         bool _rateLimit = true;
         unsigned short _eventsSent = 0;
         unsigned long _lastRateReset = 0;
+
+        struct Presence {
+            Status status = Status::ONLINE;
+            ActivityType type = ActivityType::NONE;
+            // JSON-escaped
+            char activity[DISCORD_PRESENCE_TEXT_SIZE] = "";
+
+            bool operator == (const Presence& other) const {
+                return status == other.status && type == other.type && strcmp(activity, other.activity) == 0;
+            }
+        };
+        // Guards the presence state below, which setPresence() uses from other tasks
+        SemaphoreHandle_t _presenceMtx;
+        Presence _pendingPresence;
+        Presence _sentPresence;
+        bool _presenceSet = false;
+        // Whether _sentPresence is what this session shows
+        bool _presenceShown = false;
+        bool _presencePending = false;
+        unsigned long _presenceChangedAt = 0;
+        unsigned long _lastPresenceSent = 0;
+        uint8_t _presenceSentThisMinute = 0;
+        unsigned long _lastPresenceBudgetReset = 0;
+        uint32_t _presenceCoalesced = 0;
     };
 
     inline Bot::MessageResponse::Flags operator | (Bot::MessageResponse::Flags lhs, Bot::MessageResponse::Flags rhs) {
@@ -309,7 +752,9 @@ namespace Discord {
             const String& json = "",
             const char* authorisationToken = "",
             std::function<void(const StaticJsonDocument<sz>& json)> cb = nullptr,
-            SemaphoreHandle_t* mtx = nullptr);
+            SemaphoreHandle_t* mtx = nullptr,
+            std::atomic<unsigned int>* inFlight = nullptr);
+        ~AsyncAPIRequest();
 
         HTTPClient& client;
         const char* method;
@@ -318,6 +763,8 @@ namespace Discord {
         const char* authorisationToken = "";
         std::function<void(const StaticJsonDocument<sz>& json)> callback;
         SemaphoreHandle_t* clientMtx = nullptr;
+        // Counts requests from creation until the task finishes with them
+        std::atomic<unsigned int>* inFlight = nullptr;
     };
 
     bool sendRest(
@@ -344,7 +791,8 @@ namespace Discord {
         const String& json,
         const char* authorisationToken,
         std::function<void(const StaticJsonDocument<sz>& json)> cb,
-        SemaphoreHandle_t* mtx);
+        SemaphoreHandle_t* mtx,
+        std::atomic<unsigned int>* inFlight = nullptr);
 
     template <size_t sz>
     void sendPostTask(void* parameter);
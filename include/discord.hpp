@@ -17,6 +17,7 @@
  */
 
 #include <discord.h>
+#include <log.h>
 #ifdef _DISCORD_CLIENT_DEBUG
 #include <StreamUtils.h>
 #endif
@@ -50,40 +51,20 @@ namespace Discord {
         else {
             httpResponseCode = client.sendRequest(method);
         }
-#ifdef _DISCORD_CLIENT_DEBUG
-#ifdef ESP32
-        log_d("[DISCORD] Sent %s request to %s", method, uri.c_str());
-#else
-        Serial.print(method);
-        Serial.print(" request to ");
-        Serial.println(uri);
-#endif
-#endif
+        LOG_D(DISCORD_MESSAGE_PREFIX "Sent %s request to %s", method, uri);
 
         if (httpResponseCode > 0) {
-#ifdef _DISCORD_CLIENT_DEBUG
-#ifdef ESP32
-            log_d("[DISCORD] HTTP Response code: %d", httpResponseCode);
-#else
-            Serial.print("[DISCORD] HTTP Response code: ");
-            Serial.println(httpResponseCode);
-#endif
-#endif
+            LOG_D(DISCORD_MESSAGE_PREFIX "HTTP Response code: %d", httpResponseCode);
             if (httpResponseCode != 204) { //204 no content
                 if (responseDoc)
                 {
                     // Here we pass getString instead of getStream. While ArduinoJson recommends against this,
                     // this allows us to keep the benefits of HTTP 1.1+, since Discord's payloads are usually small.
-#ifdef _DISCORD_CLIENT_DEBUG
-                    String p = client.getString();
-                    DeserializationError e = deserializeJson(*responseDoc, p);
-                    Serial.println(p);
-#else
-                    DeserializationError e = deserializeJson(*responseDoc, client.getString());
-#endif
+                    String body = client.getString();
+                    DeserializationError e = deserializeJson(*responseDoc, body);
+                    LOG_D("%s", body);
                     if (e) {
-                        Serial.print(F("deserializeJson() failed with code "));
-                        Serial.println(e.f_str());
+                        LOG_W("deserializeJson() failed with code %s", e.c_str());
 
                         // Serialisation failed, free resources
                         //client.end();
@@ -91,19 +72,20 @@ namespace Discord {
                     }
                 }
                 else {
-                    Serial.println(client.getString());
+                    // Read even when it isn't logged, so the connection is clean for the next request.
+                    String body = client.getString();
+                    LOG_D("%s", body);
                 }
             }
             if (httpResponseCode == 401) {
-                Serial.println("[DISCORD] 401 Not Authorised.");
+                LOG_W(DISCORD_MESSAGE_PREFIX "401 Not Authorised.");
                 return false;
             }
             return true;
         }
 
         // Request failed
-        Serial.print("[DISCORD] Error code: ");
-        Serial.println(httpResponseCode);
+        LOG_W(DISCORD_MESSAGE_PREFIX "Error code: %d", httpResponseCode);
         return false;
     }
 
@@ -115,14 +97,23 @@ namespace Discord {
         const String& json,
         const char* authorisationToken,
         std::function<void(const StaticJsonDocument<sz>& json)> cb,
-        SemaphoreHandle_t* mtx) :
+        SemaphoreHandle_t* mtx,
+        std::atomic<unsigned int>* inFlight) :
         client { httpClient },
         method { method },
         uri { uri },
         json { json },
         authorisationToken { authorisationToken },
         callback { cb },
-        clientMtx { mtx } {}
+        clientMtx { mtx },
+        inFlight { inFlight } {
+        if (inFlight) ++(*inFlight);
+    }
+
+    template<size_t sz>
+    AsyncAPIRequest<sz>::~AsyncAPIRequest() {
+        if (inFlight) --(*inFlight);
+    }
 
     template<size_t sz>
     void sendPostAsync(
@@ -132,26 +123,27 @@ namespace Discord {
         const String& json,
         const char* authorisationToken,
         std::function<void(const StaticJsonDocument<sz>& json)> cb,
-        SemaphoreHandle_t* mtx) {
+        SemaphoreHandle_t* mtx,
+        std::atomic<unsigned int>* inFlight) {
 
         AsyncAPIRequest<sz>* request = new AsyncAPIRequest<sz>(
-            httpClient, method, uri, json, authorisationToken, std::move(cb), mtx);
+            httpClient, method, uri, json, authorisationToken, std::move(cb), mtx, inFlight);
 
         TaskHandle_t task = nullptr;
         // Task priority of 2 will ensure the post request gets sent first within the 3s window.
         // IIRC, this also avoids the scheduler from switching back and forth, avoiding race conditions.
-        xTaskCreate(
+        if (xTaskCreate(
             sendPostTask<sz>,
             "DiscordSendPostTask",
             4 * 1024 + sz,
             static_cast<void*>(request),
-            tskIDLE_PRIORITY + 2, &task);
+            tskIDLE_PRIORITY + 2, &task) != pdPASS) {
+            LOG_E(DISCORD_MESSAGE_PREFIX "Not enough memory to start the request task.");
+            delete request;
+            return;
+        }
 
-#ifdef _DISCORD_CLIENT_DEBUG
-        Serial.print("Async task created with ");
-        Serial.print(4 * 1024 + sz);
-        Serial.println(" bytes of stack allocated.");
-#endif
+        LOG_D("Async task created with %u bytes of stack allocated.", 4 * 1024 + sz);
     }
 
     template<size_t sz>
@@ -182,35 +174,20 @@ namespace Discord {
         }
         else {
             // Request failed
-            Serial.print("[DISCORD] No payload to POST with!");
+            LOG_W(DISCORD_MESSAGE_PREFIX "No payload to POST with!");
             delete request;
             vTaskDelete(nullptr);
         }
-#ifdef ESP32
-        log_d("[DISCORD] Sent %s request to %s", request->method, request->uri.c_str());
-#else
-        Serial.print(request->method);
-        Serial.print(" request to ");
-        Serial.println(request->uri);
-#endif
-        long currentStack = uxTaskGetStackHighWaterMark(NULL);
-        Serial.print("[STACK CHECK] sendPostTask() - Free Stack Space: ");
-        Serial.println(currentStack);
+        LOG_D(DISCORD_MESSAGE_PREFIX "Sent %s request to %s", request->method, request->uri);
+        LOG_D("[STACK CHECK] sendPostTask() - Free Stack Space: %u", uxTaskGetStackHighWaterMark(NULL));
 #endif
         if (httpResponseCode > 0) {
-#ifdef _DISCORD_CLIENT_DEBUG
-#ifdef ESP32
-            log_d("[DISCORD] HTTP Response code: %d", httpResponseCode);
-#else
-            Serial.print("[DISCORD] HTTP Response code: ");
-            Serial.println(httpResponseCode);
-#endif
-#endif
+            LOG_D(DISCORD_MESSAGE_PREFIX "HTTP Response code: %d", httpResponseCode);
             if (httpResponseCode == HTTP_CODE_BAD_REQUEST) {
-                Serial.println("[DISCORD] 400 Bad Request.");
+                LOG_W(DISCORD_MESSAGE_PREFIX "400 Bad Request.");
             }
             else if (httpResponseCode == HTTP_CODE_UNAUTHORIZED) {
-                Serial.println("[DISCORD] 401 Not Authorised.");
+                LOG_W(DISCORD_MESSAGE_PREFIX "401 Not Authorised.");
             }
             else if (request->callback != nullptr) {
                 StaticJsonDocument<sz> response;
@@ -218,16 +195,11 @@ namespace Discord {
                 // Here we pass getString instead of getStream. While ArduinoJson recommends against this,
                 // this allows us to keep the benefits of HTTP 1.1+, since Discord's payloads are usually small.
                 if (httpResponseCode != HTTP_CODE_NO_CONTENT) {
-#ifdef _DISCORD_CLIENT_DEBUG
-                    String p = request->client.getString();
-                    DeserializationError e = deserializeJson(response, p);
-                    Serial.println(p);
-#else
-                    DeserializationError e = deserializeJson(response, request->client.getString());
-#endif
+                    String body = request->client.getString();
+                    DeserializationError e = deserializeJson(response, body);
+                    LOG_D("%s", body);
                     if (e) {
-                        Serial.print(F("deserializeJson() failed with code "));
-                        Serial.println(e.c_str());
+                        LOG_W("deserializeJson() failed with code %s", e.c_str());
                     }
                 }
                 request->callback(response);
@@ -243,8 +215,7 @@ namespace Discord {
         if (request->clientMtx) {
             xSemaphoreGive(*request->clientMtx);
         }
-        Serial.print("[DISCORD] Error code: ");
-        Serial.println(httpResponseCode);
+        LOG_W(DISCORD_MESSAGE_PREFIX "Error code: %d", httpResponseCode);
         delete request;
         vTaskDelete(nullptr);
     }
@@ -0,0 +1,137 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+#ifndef _DISCORD_ESP32A_EVENTRING_H_
+#define _DISCORD_ESP32A_EVENTRING_H_
+
+namespace Discord {
+    // What a full ring does with a new record
+    enum class RingPolicy {
+        // Refuse the new record, leaving backpressure to the producer
+        Reject,
+        // Evict the oldest unread record to make room
+        Overwrite
+    };
+
+    enum class PushResult {
+        Stored,
+        // The ring was full and the new record was refused (RingPolicy::Reject)
+        Rejected,
+        // The ring was full and the oldest record was evicted to make room (RingPolicy::Overwrite)
+        Evicted
+    };
+
+    /// @brief Lock-free single-producer/single-consumer ring of fixed-size records.
+    /// Exactly one task may push and exactly one task may pop. Records are copied in and out by value,
+    /// so T must be trivially copyable; pass ownership of larger payloads through a pointer member.
+    /// @tparam T Record type.
+    /// @tparam capacity Number of slots, must be a power of two.
+    template <typename T, size_t capacity>
+    class EventRing {
+        static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "EventRing capacity must be a power of two");
+        static_assert(std::is_trivially_copyable<T>::value, "EventRing records must be trivially copyable");
+
+    public:
+        explicit EventRing(RingPolicy policy = RingPolicy::Reject) : _policy { policy } {}
+
+        /// @brief Producer side. Appends a record, applying the ring's policy if it is full.
+        /// @param record Record to append.
+        /// @param evicted Receives the record evicted to make room, if any.
+        /// @return Whether the record was stored, rejected or stored by evicting another. The caller still owns
+        /// whatever a rejected or evicted record points to.
+        PushResult push(const T& record, T* evicted = nullptr) {
+            uint32_t tail = _tail.load(std::memory_order_relaxed);
+            uint32_t head = _head.load(std::memory_order_acquire);
+            PushResult result = PushResult::Stored;
+
+            if (tail - head >= capacity) {
+                if (_policy == RingPolicy::Reject) {
+                    _dropped.fetch_add(1, std::memory_order_relaxed);
+                    return PushResult::Rejected;
+                }
+
+                // Claim the oldest record from under the consumer. If the CAS fails the consumer has just
+                // taken it, which frees a slot just the same.
+                if (_head.compare_exchange_strong(head, head + 1, std::memory_order_acq_rel)) {
+                    if (evicted) *evicted = _slots[head & _mask];
+                    _dropped.fetch_add(1, std::memory_order_relaxed);
+                    result = PushResult::Evicted;
+                }
+            }
+
+            _slots[tail & _mask] = record;
+            _tail.store(tail + 1, std::memory_order_release);
+
+            uint32_t occupancy = tail + 1 - _head.load(std::memory_order_relaxed);
+            if (occupancy > _highWater.load(std::memory_order_relaxed)) {
+                _highWater.store(occupancy, std::memory_order_relaxed);
+            }
+            return result;
+        }
+
+        /// @brief Consumer side. Removes the oldest record.
+        /// @return False if the ring was empty.
+        bool pop(T& record) {
+            uint32_t head = _head.load(std::memory_order_acquire);
+            for (;;) {
+                if (head == _tail.load(std::memory_order_acquire)) return false;
+
+                T copy = _slots[head & _mask];
+                // With RingPolicy::Overwrite the producer may have evicted and rewritten this slot while it was
+                // being copied; only a successful claim of the head proves the copy is intact.
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (_head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    record = copy;
+                    return true;
+                }
+            }
+        }
+
+        // Records waiting to be popped
+        size_t size() const {
+            return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+        }
+
+        // Highest occupancy seen since construction
+        size_t highWater() const { return _highWater.load(std::memory_order_relaxed); }
+
+        // Records rejected or evicted since construction
+        uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+        static constexpr size_t slots() { return capacity; }
+
+    private:
+        static constexpr uint32_t _mask = capacity - 1;
+
+        T _slots[capacity];
+        // Free-running indices; their difference is the occupancy, even across wrap-around.
+        std::atomic<uint32_t> _head { 0 };
+        std::atomic<uint32_t> _tail { 0 };
+        std::atomic<uint32_t> _highWater { 0 };
+        std::atomic<uint32_t> _dropped { 0 };
+        const RingPolicy _policy;
+    };
+}
+
+#endif //_DISCORD_ESP32A_EVENTRING_H_
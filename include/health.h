@@ -0,0 +1,91 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <discord.h>
+
+#ifndef _DISCORD_ESP32A_HEALTH_H_
+#define _DISCORD_ESP32A_HEALTH_H_
+
+// Watches the bot's vital signs and asks for a restart only when one of them has actually gone bad.
+namespace Health {
+    struct Thresholds {
+        // Largest allocatable block below which the heap counts as fragmented. A TLS handshake needs ~16KB in one piece.
+        size_t minLargestFreeBlock = 20 * 1024;
+        // Consecutive checks the heap must stay fragmented before acting on it
+        uint8_t fragmentedChecks = 6;
+        // Failed allocations tolerated per failure window
+        uint32_t maxAllocationFailures = 3;
+        unsigned long allocationFailureWindow = 10UL * 60UL * 1000UL;
+        // How long the gateway may stay down while Wi-Fi is up
+        unsigned long maxOfflineTime = 10UL * 60UL * 1000UL;
+        // Heartbeat intervals without an acknowledgement before the connection counts as dead
+        uint8_t missedHeartbeats = 3;
+        // Smoothed interaction handler time that leaves no room inside Discord's 3 second window
+        unsigned long maxHandlerLatency = 2500;
+        // No interactions for this long before a restart counts as quiet
+        unsigned long quietPeriod = 30000;
+        // Restart anyway if it has not been quiet for this long after deciding to
+        unsigned long maxDrainTime = 10UL * 60UL * 1000UL;
+        // Time between checks
+        unsigned long checkInterval = 5000;
+    };
+
+    class Supervisor {
+    public:
+        Supervisor(Discord::Bot& bot, const Thresholds& thresholds = Thresholds());
+
+        /// @brief Starts counting failed heap allocations. Call once from setup().
+        void begin();
+
+        /// @brief Samples the bot's health. Once a threshold is crossed, waits for a quiet moment with no responses,
+        /// events or other work in flight.
+        /// @param now Current time in ms.
+        /// @param busy Whether the application still has outgoing work of its own, such as queued messages.
+        /// @return True when the device should restart now.
+        bool update(unsigned long now, bool busy = false);
+
+        // Why a restart was requested, or nullptr if everything is healthy
+        const char* reason() const { return _reason; }
+
+        // Logs the heap, allocation failures and the bot's load
+        void report() const;
+
+    private:
+        const char* check(unsigned long now);
+
+        Discord::Bot& _bot;
+        Thresholds _thresholds;
+
+        unsigned long _lastCheck = 0;
+        uint8_t _fragmentedCount = 0;
+        size_t _largestFreeBlock = 0;
+        size_t _minLargestFreeBlock = SIZE_MAX;
+        uint32_t _windowFailures = 0;
+        unsigned long _windowStart = 0;
+        unsigned long _offlineSince = 0;
+        unsigned long _lastSeenInteraction = 0;
+        // Exponentially weighted moving average of handler time, in ms
+        unsigned long _handlerLatency = 0;
+
+        const char* _reason = nullptr;
+        unsigned long _drainStart = 0;
+    };
+}
+
+#endif //_DISCORD_ESP32A_HEALTH_H_
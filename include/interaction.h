@@ -0,0 +1,135 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#ifndef _DISCORD_ESP32A_INTERACTION_H_
+#define _DISCORD_ESP32A_INTERACTION_H_
+
+// Most options an Interaction caches; any past this are not visible through the typed getters
+#ifndef DISCORD_INTERACTION_OPTIONS
+#define DISCORD_INTERACTION_OPTIONS 8
+#endif
+
+namespace Discord {
+    /// @brief Typed, read-only view of an INTERACTION_CREATE payload.
+    ///
+    /// Nothing is copied out of the JSON up front. Each field is looked up the first time it is asked for, and
+    /// snowflakes, the invoking user and the options are kept after that, so handlers can call the getters as often
+    /// as they like. Strings point into the parsed frame, so neither the view nor anything it returns may outlive the
+    /// interaction callback.
+    class Interaction {
+    public:
+        enum class Type : uint8_t {
+            INVALID,
+            PING = 1,
+            APPLICATION_COMMAND,
+            MESSAGE_COMPONENT,
+            APPLICATION_COMMAND_AUTOCOMPLETE,
+            MODAL_SUBMIT
+        };
+
+        explicit Interaction(JsonObjectConst json) : _json { json } {}
+
+        Type type() const { return static_cast<Type>(_json["type"].as<uint8_t>()); }
+        uint64_t id() const { return snowflake(Cached::Id, _id, _json["id"]); }
+        uint64_t applicationId() const { return _json["application_id"].as<uint64_t>(); }
+        // Only valid for 15 minutes after the interaction was received
+        const char* token() const { return _json["token"] | ""; }
+        // Zero for interactions from DMs
+        uint64_t guildId() const { return snowflake(Cached::GuildId, _guildId, _json["guild_id"]); }
+        uint64_t channelId() const { return snowflake(Cached::ChannelId, _channelId, _json["channel_id"]); }
+        // The user's chosen language; the guild's is guildLocale()
+        const char* locale() const { return _json["locale"] | ""; }
+        const char* guildLocale() const { return _json["guild_locale"] | ""; }
+
+        /// @brief Name of the command used, or custom_id for components and modals.
+        const char* name() const;
+        uint64_t commandId() const { return snowflake(Cached::CommandId, _commandId, data()["id"]); }
+        /// @brief Name of the subcommand used, or nullptr.
+        const char* subcommand() const { cacheOptions(); return _subcommand; }
+        /// @brief Name of the group the subcommand belongs to, or nullptr.
+        const char* subcommandGroup() const { cacheOptions(); return _subcommandGroup; }
+
+        /// @brief Whoever used the interaction, from member.user in guilds and user in DMs.
+        uint64_t userId() const;
+        const char* username() const;
+        /// @brief The invoking member's role ids, as strings. Empty in DMs.
+        JsonArrayConst roles() const { return _json["member"]["roles"].as<JsonArrayConst>(); }
+
+        /// @brief Whether the option was given. Options inside a subcommand are found by their own name.
+        bool hasOption(const char* name) const { return !option(name).isNull(); }
+        const char* getString(const char* name, const char* fallback = "") const { return option(name) | fallback; }
+        int64_t getInteger(const char* name, int64_t fallback = 0) const { return option(name) | fallback; }
+        double getNumber(const char* name, double fallback = 0) const { return option(name) | fallback; }
+        bool getBoolean(const char* name, bool fallback = false) const { return option(name) | fallback; }
+        /// @brief User, channel, role and mentionable options, which Discord sends as snowflake strings.
+        uint64_t getSnowflake(const char* name) const { return option(name).as<uint64_t>(); }
+        /// @brief The option focused by an autocomplete interaction, or nullptr.
+        const char* focusedOption() const;
+
+        /// @brief The underlying JSON, for anything the getters don't cover.
+        JsonObjectConst json() const { return _json; }
+
+    private:
+        enum Cached : uint8_t {
+            Id = 1 << 0,
+            GuildId = 1 << 1,
+            ChannelId = 1 << 2,
+            CommandId = 1 << 3,
+            User = 1 << 4,
+            Options = 1 << 5
+        };
+
+        struct CachedOption {
+            const char* name;
+            JsonVariantConst value;
+            bool focused;
+        };
+
+        uint64_t snowflake(Cached field, uint64_t& cache, JsonVariantConst value) const {
+            if (!(_cached & field)) {
+                cache = value.as<uint64_t>();
+                _cached |= field;
+            }
+            return cache;
+        }
+        JsonObjectConst data() const { return _json["data"].as<JsonObjectConst>(); }
+        JsonObjectConst user() const;
+        JsonVariantConst option(const char* name) const;
+        void cacheOptions() const;
+
+        JsonObjectConst _json;
+        mutable uint8_t _cached = 0;
+        mutable uint64_t _id = 0;
+        mutable uint64_t _guildId = 0;
+        mutable uint64_t _channelId = 0;
+        mutable uint64_t _commandId = 0;
+        mutable uint64_t _userId = 0;
+        mutable JsonObjectConst _user;
+        mutable const char* _subcommand = nullptr;
+        mutable const char* _subcommandGroup = nullptr;
+        mutable CachedOption _options[DISCORD_INTERACTION_OPTIONS];
+        mutable uint8_t _optionsLength = 0;
+    };
+}
+
+#endif //_DISCORD_ESP32A_INTERACTION_H_
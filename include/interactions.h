@@ -67,6 +67,8 @@ namespace Discord::Interactions {
             bool required;
             Choice* choices;
             size_t choicesLength = 0;
+            // Suggest values as the user types, see Bot::addAutocomplete(). Only for options without choices.
+            bool autocomplete = false;
         };
 
         const char* name;
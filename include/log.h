@@ -0,0 +1,170 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+
+#ifndef _DISCORD_ESP32A_LOG_H_
+#define _DISCORD_ESP32A_LOG_H_
+
+#define LOGGER_LEVEL_NONE 0
+#define LOGGER_LEVEL_ERROR 1
+#define LOGGER_LEVEL_WARN 2
+#define LOGGER_LEVEL_INFO 3
+#define LOGGER_LEVEL_DEBUG 4
+
+// Messages above this level are compiled out, arguments and all
+#ifndef LOGGER_LEVEL
+#ifdef _DISCORD_CLIENT_DEBUG
+#define LOGGER_LEVEL LOGGER_LEVEL_DEBUG
+#else
+#define LOGGER_LEVEL LOGGER_LEVEL_INFO
+#endif
+#endif
+// Messages that can wait to be written at once, must be a power of two. Any more are dropped and counted.
+#ifndef LOGGER_RECORDS
+#define LOGGER_RECORDS 64
+#endif
+// Bytes of arguments per message: 9 per number, string length + 2 per string. Arguments past this are left out.
+#ifndef LOGGER_ARGS_SIZE
+#define LOGGER_ARGS_SIZE 72
+#endif
+// Longest line the drain task writes
+#ifndef LOGGER_LINE_SIZE
+#define LOGGER_LINE_SIZE 192
+#endif
+
+static_assert((LOGGER_RECORDS & (LOGGER_RECORDS - 1)) == 0, "LOGGER_RECORDS must be a power of two");
+
+/// @brief printf-style logging that never blocks the caller. Each macro copies the format string's address and its
+/// arguments into a lock-free ring, and a low priority task formats and writes them out later, one line per message.
+/// The format must be a string literal; strings passed as arguments are copied, so they may be temporaries.
+#if LOGGER_LEVEL >= LOGGER_LEVEL_ERROR
+#define LOG_E(format, ...) Log::write(Log::Level::Error, "" format, ##__VA_ARGS__)
+#else
+#define LOG_E(format, ...) do {} while (0)
+#endif
+#if LOGGER_LEVEL >= LOGGER_LEVEL_WARN
+#define LOG_W(format, ...) Log::write(Log::Level::Warn, "" format, ##__VA_ARGS__)
+#else
+#define LOG_W(format, ...) do {} while (0)
+#endif
+#if LOGGER_LEVEL >= LOGGER_LEVEL_INFO
+#define LOG_I(format, ...) Log::write(Log::Level::Info, "" format, ##__VA_ARGS__)
+#else
+#define LOG_I(format, ...) do {} while (0)
+#endif
+#if LOGGER_LEVEL >= LOGGER_LEVEL_DEBUG
+#define LOG_D(format, ...) Log::write(Log::Level::Debug, "" format, ##__VA_ARGS__)
+#else
+#define LOG_D(format, ...) do {} while (0)
+#endif
+
+namespace Log {
+    enum class Level : uint8_t {
+        Error = LOGGER_LEVEL_ERROR,
+        Warn,
+        Info,
+        Debug
+    };
+
+    /// @brief Starts the task that writes queued messages out. Messages logged before this wait in the ring.
+    /// @param out Where messages go, usually Serial.
+    /// @param priority Keep it below every task that logs, so writing never delays them.
+    bool begin(Print& out, UBaseType_t priority = tskIDLE_PRIORITY + 1);
+
+    /// @brief Writes everything queued so far from the calling task, e.g. just before a restart.
+    void flush();
+
+    // Messages dropped because the ring was full
+    uint32_t dropped();
+
+    namespace Detail {
+        struct Record {
+            // Which position the slot is free for, or holds a message for; see log.cpp
+            std::atomic<uint32_t> state;
+            uint32_t position;
+            unsigned long time;
+            const char* format;
+            Level level;
+            uint8_t length;
+            // A type tag ('i', 'u', 'f' or 's') followed by the value, per argument
+            uint8_t args[LOGGER_ARGS_SIZE];
+        };
+
+        // Null if the ring is full
+        Record* claim();
+        void publish(Record& record);
+
+        class Encoder {
+        public:
+            explicit Encoder(Record& record) : _record { record } {}
+
+            template <typename T>
+            typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type put(T value) {
+                int64_t wide = value;
+                raw('i', &wide, sizeof(wide));
+            }
+            template <typename T>
+            typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type put(T value) {
+                uint64_t wide = value;
+                raw('u', &wide, sizeof(wide));
+            }
+            template <typename T>
+            typename std::enable_if<std::is_floating_point<T>::value>::type put(T value) {
+                double wide = value;
+                raw('f', &wide, sizeof(wide));
+            }
+            template <typename T>
+            typename std::enable_if<std::is_enum<T>::value>::type put(T value) {
+                put(static_cast<typename std::underlying_type<T>::type>(value));
+            }
+            template <typename T>
+            void put(const T* pointer) {
+                uint64_t wide = reinterpret_cast<uintptr_t>(pointer);
+                raw('u', &wide, sizeof(wide));
+            }
+            void put(const char* value);
+            void put(char* value) { put(static_cast<const char*>(value)); }
+            void put(const String& value) { put(value.c_str()); }
+
+        private:
+            void raw(char tag, const void* value, size_t size);
+
+            Record& _record;
+        };
+    }
+
+    template <typename... Args>
+    void write(Level level, const char* format, const Args&... args) {
+        Detail::Record* record = Detail::claim();
+        if (!record) return;
+        record->time = millis();
+        record->format = format;
+        record->level = level;
+        record->length = 0;
+
+        Detail::Encoder encoder(*record);
+        int expand[] = { 0, (encoder.put(args), 0)... };
+        (void)expand;
+        Detail::publish(*record);
+    }
+}
+
+#endif //_DISCORD_ESP32A_LOG_H_
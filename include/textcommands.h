@@ -0,0 +1,86 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#include <interactions.h>
+
+#ifndef _DISCORD_ESP32A_TEXTCOMMANDS_H_
+#define _DISCORD_ESP32A_TEXTCOMMANDS_H_
+
+// Nodes in the trie of command names, one per character not shared with an earlier name
+#ifndef DISCORD_COMMAND_TRIE_NODES
+#define DISCORD_COMMAND_TRIE_NODES 128
+#endif
+// Longest text command kept, arguments included, in bytes; anything past it is cut off
+#ifndef DISCORD_TEXT_COMMAND_SIZE
+#define DISCORD_TEXT_COMMAND_SIZE 256
+#endif
+// Most arguments a text command is split into
+#ifndef DISCORD_TEXT_COMMAND_ARGS
+#define DISCORD_TEXT_COMMAND_ARGS 8
+#endif
+
+namespace Discord {
+    /// @brief Finds the command a message names, in a trie of the command names built once from the command table.
+    /// Matching is case-insensitive, walks the message a character at a time and never allocates.
+    class CommandTrie {
+    public:
+        /// @brief Builds the trie. The table is not copied, so it must outlive the trie.
+        /// @return Whether every name fit in DISCORD_COMMAND_TRIE_NODES.
+        bool build(const Interactions::ApplicationCommand* commands, size_t length);
+
+        /// @brief The command text starts with, if its name is followed by whitespace or the end of text.
+        /// @param length Set to the length of the matched name.
+        /// @return The command, or nullptr if text doesn't start with one.
+        const Interactions::ApplicationCommand* match(const char* text, size_t& length) const;
+
+        bool empty() const { return _length == 0; }
+
+    private:
+        struct Node {
+            char label;
+            // Index into the table plus one, 0 if no name ends here
+            uint8_t command;
+            // Node indices, 0 for none since the root is nobody's child or sibling
+            uint16_t child;
+            uint16_t sibling;
+        };
+
+        Node _nodes[DISCORD_COMMAND_TRIE_NODES];
+        uint16_t _length = 0;
+        const Interactions::ApplicationCommand* _commands = nullptr;
+    };
+
+    /// @brief A text command's arguments, split on whitespace. "Double quotes" keep spaces in an argument.
+    /// The text is copied into a fixed buffer and split in place, so nothing is allocated.
+    class Arguments {
+    public:
+        explicit Arguments(const char* text);
+
+        size_t size() const { return _length; }
+        const char* operator [] (size_t index) const { return index < _length ? _arguments[index] : ""; }
+
+    private:
+        char _buffer[DISCORD_TEXT_COMMAND_SIZE];
+        const char* _arguments[DISCORD_TEXT_COMMAND_ARGS];
+        uint8_t _length = 0;
+    };
+}
+
+#endif //_DISCORD_ESP32A_TEXTCOMMANDS_H_
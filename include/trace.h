@@ -0,0 +1,87 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+
+#ifndef _DISCORD_ESP32A_TRACE_H_
+#define _DISCORD_ESP32A_TRACE_H_
+
+// Events kept in RAM, 12 bytes each; the oldest are overwritten first. Set to 0 to compile tracing out.
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 256
+#endif
+// Distinct tasks the trace can tell apart; events from any more are put down to the last one
+#ifndef TRACE_TASKS
+#define TRACE_TASKS 8
+#endif
+
+#if TRACE_EVENTS > 0
+#define TRACE_EVENT(event, arg) Trace::record(Trace::Event::event, arg)
+#else
+#define TRACE_EVENT(event, arg) do {} while (0)
+#endif
+
+/// @brief Timestamped binary events in a fixed ring, for seeing how tasks interleave around a slow response. Recording
+/// an event costs an atomic increment and a 12 byte store, so it can stay on in production builds.
+///
+/// A dump is little-endian: a 16 byte header ("DTRC", uint16 version, uint16 task count, uint32 event count,
+/// uint32 micros() at the dump), a 16 byte name per task, then the events oldest first. tools/trace2chrome.py turns
+/// one into Chrome trace JSON, for chrome://tracing or Perfetto.
+namespace Trace {
+    enum class Event : uint8_t {
+        // arg: frame length
+        FrameReceived = 1,
+        // arg: gateway op code
+        ParseDone,
+        // arg: low 32 bits of the interaction id
+        HandlerStart,
+        HandlerEnd,
+        // arg: response slot
+        RestEnqueue,
+        RestSend,
+        // arg: HTTP status code, or a negative HTTPClient error
+        RestComplete,
+        // arg: sequence number
+        HeartbeatSend,
+        HeartbeatAck,
+        // arg: 1 if the packet was sent
+        WolSent
+    };
+
+    struct Record {
+        uint32_t time;
+        uint32_t arg;
+        Event event;
+        uint8_t task;
+        uint16_t reserved;
+    };
+
+    void record(Event event, uint32_t arg = 0);
+
+    /// @brief Most bytes serialize() can need.
+    size_t maxSize();
+
+    /// @brief Writes the trace in the dump format into buffer. Recording pauses meanwhile.
+    /// @return Bytes written, or 0 if buffer is too small.
+    size_t serialize(uint8_t* buffer, size_t capacity);
+
+    /// @brief Writes a dump to a serial monitor as hex lines prefixed with [TRACE], between begin and end lines.
+    void dump(Print& out);
+}
+
+#endif //_DISCORD_ESP32A_TRACE_H_
@@ -0,0 +1,196 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <functional>
+#include <string>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+#ifndef _DISCORD_ESP32A_NATIVE_ARDUINO_H_
+#define _DISCORD_ESP32A_NATIVE_ARDUINO_H_
+
+typedef uint8_t byte;
+
+#define F(string_literal) (string_literal)
+
+// The ESP-IDF log macros; the client only uses them for diagnostics, so they compile away
+#define log_e(format, ...) do {} while (0)
+#define log_w(format, ...) do {} while (0)
+#define log_i(format, ...) do {} while (0)
+#define log_d(format, ...) do {} while (0)
+#define log_v(format, ...) do {} while (0)
+
+// glibc only gained strlcpy in 2.38
+inline size_t native_strlcpy(char* destination, const char* source, size_t size) {
+    size_t length = strlen(source);
+    if (size) {
+        size_t copied = length < size - 1 ? length : size - 1;
+        memcpy(destination, source, copied);
+        destination[copied] = '\0';
+    }
+    return length;
+}
+#define strlcpy native_strlcpy
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+long random(long max);
+long random(long min, long max);
+
+class String {
+public:
+    String(const char* value = "") : _value { value ? value : "" } {}
+    String(const std::string& value) : _value { value } {}
+    String(char value) : _value(1, value) {}
+    String(int value) : _value { std::to_string(value) } {}
+    String(unsigned int value) : _value { std::to_string(value) } {}
+    String(long value) : _value { std::to_string(value) } {}
+    String(unsigned long value) : _value { std::to_string(value) } {}
+    String(long long value) : _value { std::to_string(value) } {}
+    String(unsigned long long value) : _value { std::to_string(value) } {}
+    String(double value, unsigned int decimals = 2);
+
+    // Copies into the existing buffer, like Arduino's, so assigning to a reserved String doesn't allocate
+    String& operator = (const char* value) { _value.assign(value ? value : ""); return *this; }
+
+    bool reserve(unsigned int size) { _value.reserve(size); return true; }
+    unsigned int length() const { return _value.length(); }
+    bool isEmpty() const { return _value.empty(); }
+    const char* c_str() const { return _value.c_str(); }
+    void clear() { _value.clear(); }
+
+    bool concat(const String& value) { _value += value._value; return true; }
+    bool concat(const char* value) { if (value) _value += value; return true; }
+    bool concat(const char* value, unsigned int length) { if (value) _value.append(value, length); return true; }
+    bool concat(char value) { _value += value; return true; }
+    template <typename T>
+    bool concat(T value) { return concat(String(value)); }
+
+    template <typename T>
+    String& operator += (const T& value) { concat(value); return *this; }
+
+    bool equals(const String& other) const { return _value == other._value; }
+    bool equals(const char* other) const { return _value == (other ? other : ""); }
+    bool operator == (const String& other) const { return equals(other); }
+    bool operator == (const char* other) const { return equals(other); }
+    bool operator != (const String& other) const { return !equals(other); }
+    bool operator != (const char* other) const { return !equals(other); }
+
+    char operator [] (unsigned int index) const { return index < _value.length() ? _value[index] : '\0'; }
+    bool startsWith(const String& prefix) const { return _value.compare(0, prefix._value.length(), prefix._value) == 0; }
+    bool endsWith(const String& suffix) const {
+        return _value.length() >= suffix._value.length()
+            && _value.compare(_value.length() - suffix._value.length(), std::string::npos, suffix._value) == 0;
+    }
+    int indexOf(char value, unsigned int from = 0) const {
+        size_t index = _value.find(value, from);
+        return index == std::string::npos ? -1 : static_cast<int>(index);
+    }
+    int indexOf(const String& value, unsigned int from = 0) const {
+        size_t index = _value.find(value._value, from);
+        return index == std::string::npos ? -1 : static_cast<int>(index);
+    }
+    String substring(unsigned int from) const { return from < _value.length() ? String(_value.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        return from < to && from < _value.length() ? String(_value.substr(from, to - from)) : String();
+    }
+    long toInt() const { return strtol(_value.c_str(), nullptr, 10); }
+
+private:
+    std::string _value;
+};
+
+// ArduinoJson recognises both of these as strings
+class StringSumHelper : public String {
+public:
+    using String::String;
+    StringSumHelper(const String& value) : String(value) {}
+};
+
+template <typename T>
+inline StringSumHelper operator + (const String& lhs, const T& rhs) {
+    StringSumHelper sum(lhs);
+    sum.concat(rhs);
+    return sum;
+}
+
+inline StringSumHelper operator + (const char* lhs, const String& rhs) {
+    StringSumHelper sum(lhs);
+    sum.concat(rhs);
+    return sum;
+}
+
+class Print {
+public:
+    virtual ~Print() = default;
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t written = 0;
+        while (size--) written += write(*buffer++);
+        return written;
+    }
+    size_t write(const char* text) { return text ? write(reinterpret_cast<const uint8_t*>(text), strlen(text)) : 0; }
+
+    size_t print(const char* text) { return write(text); }
+    size_t print(const String& text) { return write(text.c_str()); }
+    size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+    size_t print(int value) { return print(String(value)); }
+    size_t print(unsigned int value) { return print(String(value)); }
+    size_t print(long value) { return print(String(value)); }
+    size_t print(unsigned long value) { return print(String(value)); }
+    size_t print(long long value) { return print(String(value)); }
+    size_t print(unsigned long long value) { return print(String(value)); }
+    size_t print(double value, int decimals = 2) { return print(String(value, decimals)); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T& value) { return print(value) + println(); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+// Serial only writes to stdout when echo is set
+class HardwareSerial : public Print {
+public:
+    void begin(unsigned long) {}
+    void flush() { if (echo) fflush(stdout); }
+
+    using Print::write;
+    size_t write(uint8_t c) override { if (echo) fputc(c, stdout); return 1; }
+    size_t write(const uint8_t* buffer, size_t size) override { if (echo) fwrite(buffer, 1, size, stdout); return size; }
+
+    bool echo = false;
+};
+
+extern HardwareSerial Serial;
+
+#endif //_DISCORD_ESP32A_NATIVE_ARDUINO_H_
@@ -0,0 +1,81 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <atomic>
+
+#ifndef _DISCORD_ESP32A_NATIVE_HTTPCLIENT_H_
+#define _DISCORD_ESP32A_NATIVE_HTTPCLIENT_H_
+
+typedef enum {
+    HTTP_CODE_OK = 200,
+    HTTP_CODE_NO_CONTENT = 204,
+    HTTP_CODE_BAD_REQUEST = 400,
+    HTTP_CODE_UNAUTHORIZED = 401,
+    HTTP_CODE_FORBIDDEN = 403,
+    HTTP_CODE_NOT_FOUND = 404,
+    HTTP_CODE_TOO_MANY_REQUESTS = 429,
+    HTTP_CODE_INTERNAL_SERVER_ERROR = 500
+} t_http_codes;
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+
+/// @brief Answers requests from HTTPClient::responder instead of the network.
+class HTTPClient {
+public:
+    /// @brief Produces the status code and body for a request. uri is the path, without the host.
+    typedef std::function<int(const char* method, const String& uri, const uint8_t* body, size_t length,
+        String& response)> Responder;
+
+    bool begin(const String& url, const char* CAcert = nullptr);
+    bool begin(WiFiClient& client, const String& host, uint16_t port, const String& uri = "/", bool https = false);
+    void end() { _uri.clear(); }
+    bool setURL(const String& url);
+    void setReuse(bool) {}
+    void setTimeout(uint16_t) {}
+    void addHeader(const String&, const String&, bool = false, bool = true) {}
+
+    int GET() { return sendRequest("GET"); }
+    int POST(uint8_t* payload, size_t size) { return sendRequest("POST", payload, size); }
+    int POST(const String& payload) { return sendRequest("POST", payload); }
+    int sendRequest(const char* method, const String& payload) {
+        return sendRequest(method, reinterpret_cast<const uint8_t*>(payload.c_str()), payload.length());
+    }
+    int sendRequest(const char* method, const uint8_t* payload = nullptr, size_t size = 0);
+
+    String getString() { return _response; }
+    int getSize() { return _response.length(); }
+
+    /// @brief Answers Get Gateway with wss://gateway.discord.gg and anything else with 204 No Content, which is
+    /// all a bot needs to log in and respond. The default responder.
+    static int gatewayResponder(const char* method, const String& uri, const uint8_t* body, size_t length,
+        String& response);
+
+    // Shared by every client. Set it before the clients are used.
+    static Responder responder;
+    static std::atomic<unsigned long> requests;
+
+private:
+    String _uri;
+    String _response;
+};
+
+#endif //_DISCORD_ESP32A_NATIVE_HTTPCLIENT_H_
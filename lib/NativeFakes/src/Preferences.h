@@ -0,0 +1,50 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <Arduino.h>
+
+#ifndef _DISCORD_ESP32A_NATIVE_PREFERENCES_H_
+#define _DISCORD_ESP32A_NATIVE_PREFERENCES_H_
+
+// NVS in memory, shared by every instance and lost when the process exits
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false);
+    void end() { _namespace.clear(); }
+    bool clear();
+    bool remove(const char* key);
+    bool isKey(const char* key);
+
+    size_t putString(const char* key, const char* value);
+    size_t putString(const char* key, const String& value) { return putString(key, value.c_str()); }
+    String getString(const char* key, const String& defaultValue = String());
+    size_t putLong64(const char* key, int64_t value);
+    int64_t getLong64(const char* key, int64_t defaultValue = 0);
+    size_t putULong(const char* key, uint32_t value) { return putLong64(key, value); }
+    uint32_t getULong(const char* key, uint32_t defaultValue = 0) { return getLong64(key, defaultValue); }
+
+private:
+    std::string path(const char* key) const { return _namespace + "/" + key; }
+
+    std::string _namespace;
+    bool _readOnly = false;
+};
+
+#endif //_DISCORD_ESP32A_NATIVE_PREFERENCES_H_
@@ -0,0 +1,94 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <Arduino.h>
+
+#ifndef _DISCORD_ESP32A_NATIVE_WEBSOCKETSCLIENT_H_
+#define _DISCORD_ESP32A_NATIVE_WEBSOCKETSCLIENT_H_
+
+// Room the real client needs in front of a payload passed with headerToPayload
+#define WEBSOCKETS_MAX_HEADER_SIZE (14)
+
+typedef enum {
+    WStype_ERROR,
+    WStype_DISCONNECTED,
+    WStype_CONNECTED,
+    WStype_TEXT,
+    WStype_BIN,
+    WStype_FRAGMENT_TEXT_START,
+    WStype_FRAGMENT_BIN_START,
+    WStype_FRAGMENT,
+    WStype_FRAGMENT_FIN,
+    WStype_PING,
+    WStype_PONG,
+} WStype_t;
+
+/// @brief A WebSocket client with the gateway on the other end played by the caller: frames the client sends go
+/// to onSend, and receive() delivers frames to the event handler as if they came off the socket.
+class WebSocketsClient {
+public:
+    typedef std::function<void(WStype_t type, uint8_t* payload, size_t length)> WebSocketClientEvent;
+    typedef std::function<void(const char* payload, size_t length)> SendHandler;
+
+    WebSocketsClient() { last = this; }
+    ~WebSocketsClient() { if (last == this) last = nullptr; }
+
+    void onEvent(WebSocketClientEvent cbEvent) { _event = cbEvent; }
+    // Only records the target; the caller decides when the connection opens by delivering WStype_CONNECTED.
+    void begin(const String& host, uint16_t port, const String& url = "/", const String& protocol = "arduino");
+    void beginSSL(const String& host, uint16_t port, const String& url = "/", const String& fingerprint = "",
+        const String& protocol = "arduino");
+    void loop() {}
+    void disconnect();
+    bool isConnected() { return _connected; }
+
+    bool sendTXT(uint8_t* payload, size_t length = 0, bool headerToPayload = false);
+    bool sendTXT(const uint8_t* payload, size_t length = 0) { return sendTXT(const_cast<uint8_t*>(payload), length); }
+    bool sendTXT(char* payload, size_t length = 0, bool headerToPayload = false) {
+        return sendTXT(reinterpret_cast<uint8_t*>(payload), length, headerToPayload);
+    }
+    bool sendTXT(const char* payload, size_t length = 0) {
+        return sendTXT(reinterpret_cast<uint8_t*>(const_cast<char*>(payload)), length);
+    }
+    bool sendTXT(const String& payload) { return sendTXT(payload.c_str(), payload.length()); }
+
+    /// @brief Delivers a frame to the event handler on the calling thread. WStype_CONNECTED and
+    /// WStype_DISCONNECTED also update isConnected().
+    void receive(WStype_t type, uint8_t* payload = nullptr, size_t length = 0);
+    /// @brief Delivers HELLO, as the gateway does once the connection is open.
+    void hello(unsigned long heartbeatInterval = 41250);
+
+    const String& host() const { return _host; }
+    const String& url() const { return _url; }
+
+    SendHandler onSend;
+    unsigned long framesSent = 0;
+
+    // The most recently constructed client, for harnesses that can't reach the one inside Discord::Bot
+    static WebSocketsClient* last;
+
+private:
+    WebSocketClientEvent _event;
+    String _host;
+    String _url;
+    bool _connected = false;
+};
+
+#endif //_DISCORD_ESP32A_NATIVE_WEBSOCKETSCLIENT_H_
@@ -0,0 +1,60 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+#ifndef _DISCORD_ESP32A_NATIVE_WIFI_H_
+#define _DISCORD_ESP32A_NATIVE_WIFI_H_
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL,
+    WL_SCAN_COMPLETED,
+    WL_CONNECTED,
+    WL_CONNECT_FAILED,
+    WL_CONNECTION_LOST,
+    WL_DISCONNECTED
+} wl_status_t;
+
+class IPAddress {
+public:
+    IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : _octets { a, b, c, d } {}
+    uint8_t operator [] (int index) const { return _octets[index]; }
+    String toString() const;
+
+private:
+    uint8_t _octets[4];
+};
+
+// Always connected, and every host resolves to 127.0.0.1
+class WiFiClass {
+public:
+    bool isConnected() { return connected; }
+    wl_status_t status() { return connected ? WL_CONNECTED : WL_DISCONNECTED; }
+    int hostByName(const char*, IPAddress& result) { result = IPAddress(127, 0, 0, 1); return 1; }
+    IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+
+    bool connected = true;
+};
+
+extern WiFiClass WiFi;
+
+#endif //_DISCORD_ESP32A_NATIVE_WIFI_H_
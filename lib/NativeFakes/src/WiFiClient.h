@@ -0,0 +1,39 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <Arduino.h>
+
+#ifndef _DISCORD_ESP32A_NATIVE_WIFICLIENT_H_
+#define _DISCORD_ESP32A_NATIVE_WIFICLIENT_H_
+
+// Connection state only; no bytes ever move
+class WiFiClient {
+public:
+    virtual ~WiFiClient() = default;
+
+    int connect(const char*, uint16_t) { _connected = true; return 1; }
+    uint8_t connected() { return _connected; }
+    void stop() { _connected = false; }
+
+protected:
+    bool _connected = false;
+};
+
+#endif //_DISCORD_ESP32A_NATIVE_WIFICLIENT_H_
@@ -0,0 +1,42 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <WiFi.h>
+
+#ifndef _DISCORD_ESP32A_NATIVE_WIFIUDP_H_
+#define _DISCORD_ESP32A_NATIVE_WIFIUDP_H_
+
+// Packets are counted, not sent
+class WiFiUDP : public Print {
+public:
+    uint8_t begin(uint16_t) { return 1; }
+    void stop() {}
+    int beginPacket(IPAddress, uint16_t) { return 1; }
+    int beginPacket(const char*, uint16_t) { return 1; }
+    int endPacket() { ++packetsSent; return 1; }
+
+    using Print::write;
+    size_t write(uint8_t) override { return 1; }
+    size_t write(const uint8_t*, size_t size) override { return size; }
+
+    unsigned long packetsSent = 0;
+};
+
+#endif //_DISCORD_ESP32A_NATIVE_WIFIUDP_H_
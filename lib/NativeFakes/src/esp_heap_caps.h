@@ -0,0 +1,37 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _DISCORD_ESP32A_NATIVE_ESP_HEAP_CAPS_H_
+#define _DISCORD_ESP32A_NATIVE_ESP_HEAP_CAPS_H_
+
+#define MALLOC_CAP_8BIT (1 << 2)
+
+// The host never runs short, so admission control always sees plenty of heap
+inline size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return 4 * 1024 * 1024;
+}
+
+inline size_t heap_caps_get_free_size(uint32_t caps) {
+    return 4 * 1024 * 1024;
+}
+
+#endif //_DISCORD_ESP32A_NATIVE_ESP_HEAP_CAPS_H_
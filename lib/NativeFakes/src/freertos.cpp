@@ -0,0 +1,219 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+struct NativeTask {
+    char name[16] = "main";
+    std::mutex mtx;
+    std::condition_variable notified;
+    uint32_t notifications = 0;
+};
+
+struct NativeQueue {
+    std::mutex mtx;
+    std::condition_variable changed;
+    std::vector<uint8_t> storage;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    UBaseType_t head = 0;
+    UBaseType_t count = 0;
+};
+
+struct NativeMutex {
+    std::timed_mutex mtx;
+};
+
+namespace {
+    // Thrown through a task's own stack by vTaskDelete(nullptr), caught where the thread started
+    struct TaskExit {};
+
+    // The task running on this thread; threads not started by xTaskCreate get one on first use
+    thread_local NativeTask* currentTask = nullptr;
+
+    std::chrono::milliseconds toDuration(TickType_t ticks) {
+        return std::chrono::milliseconds(ticks);
+    }
+
+    template <typename Lock, typename Predicate>
+    bool waitFor(std::condition_variable& cv, Lock& lock, TickType_t ticks, Predicate ready) {
+        if (ticks == portMAX_DELAY) {
+            cv.wait(lock, ready);
+            return true;
+        }
+        return cv.wait_for(lock, toDuration(ticks), ready);
+    }
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t, void* parameter,
+    UBaseType_t, TaskHandle_t* handle, BaseType_t) {
+    // Never freed: handles stay valid for notifications for the life of the process, like static tasks
+    NativeTask* task = new NativeTask();
+    if (name) snprintf(task->name, sizeof(task->name), "%s", name);
+    if (handle) *handle = task;
+
+    std::thread([function, parameter, task]() {
+        currentTask = task;
+        try {
+            function(parameter);
+        }
+        catch (const TaskExit&) {}
+        }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameter,
+    UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(function, name, stackDepth, parameter, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    // Other tasks can't be stopped from outside a thread; nothing in the client does that.
+    if (task == nullptr || task == currentTask) throw TaskExit();
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (ticks == 0) std::this_thread::yield();
+    else std::this_thread::sleep_for(toDuration(ticks));
+}
+
+TickType_t xTaskGetTickCount() {
+    static const auto start = std::chrono::steady_clock::now();
+    return static_cast<TickType_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    if (!currentTask) currentTask = new NativeTask();
+    return currentTask;
+}
+
+char* pcTaskGetName(TaskHandle_t task) {
+    return (task ? task : xTaskGetCurrentTaskHandle())->name;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) {
+    return 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    {
+        std::lock_guard<std::mutex> lock(task->mtx);
+        ++task->notifications;
+    }
+    task->notified.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait) {
+    NativeTask* task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mtx);
+    waitFor(task->notified, lock, ticksToWait, [task]() { return task->notifications > 0; });
+
+    uint32_t count = task->notifications;
+    if (count) task->notifications = clearCountOnExit ? 0 : count - 1;
+    return count;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    NativeQueue* queue = new NativeQueue();
+    queue->storage.resize(static_cast<size_t>(length) * itemSize);
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+    std::unique_lock<std::mutex> lock(queue->mtx);
+    if (!waitFor(queue->changed, lock, ticksToWait, [queue]() { return queue->count < queue->length; })) {
+        return pdFALSE;
+    }
+
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->storage[static_cast<size_t>(tail) * queue->itemSize], item, queue->itemSize);
+    ++queue->count;
+    lock.unlock();
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+    return xQueueSend(queue, item, ticksToWait);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticksToWait) {
+    std::unique_lock<std::mutex> lock(queue->mtx);
+    if (!waitFor(queue->changed, lock, ticksToWait, [queue]() { return queue->count > 0; })) {
+        return pdFALSE;
+    }
+
+    memcpy(item, &queue->storage[static_cast<size_t>(queue->head) * queue->itemSize], queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    --queue->count;
+    lock.unlock();
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mtx);
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mtx);
+    return queue->length - queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return new NativeMutex();
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    delete semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait) {
+    if (ticksToWait == portMAX_DELAY) {
+        semaphore->mtx.lock();
+        return pdTRUE;
+    }
+    if (ticksToWait == 0) return semaphore->mtx.try_lock() ? pdTRUE : pdFALSE;
+    return semaphore->mtx.try_lock_for(toDuration(ticksToWait)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    semaphore->mtx.unlock();
+    return pdTRUE;
+}
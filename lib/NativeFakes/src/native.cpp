@@ -0,0 +1,225 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <Preferences.h>
+#include <WebSocketsClient.h>
+#include <WiFi.h>
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+
+HardwareSerial Serial;
+WiFiClass WiFi;
+
+namespace {
+    const auto startTime = std::chrono::steady_clock::now();
+
+    std::mt19937& generator() {
+        static std::mt19937 instance(std::random_device{}());
+        return instance;
+    }
+
+    // Namespaced keys of every Preferences instance
+    std::mutex nvsMtx;
+    std::map<std::string, std::string>& nvs() {
+        static std::map<std::string, std::string> store;
+        return store;
+    }
+}
+
+unsigned long millis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+long random(long max) {
+    return random(0, max);
+}
+
+long random(long min, long max) {
+    if (min >= max) return min;
+    return std::uniform_int_distribution<long>(min, max - 1)(generator());
+}
+
+String::String(double value, unsigned int decimals) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+    _value = buffer;
+}
+
+size_t Print::printf(const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) return 0;
+    return write(reinterpret_cast<const uint8_t*>(buffer), static_cast<size_t>(length) < sizeof(buffer)
+        ? static_cast<size_t>(length) : sizeof(buffer) - 1);
+}
+
+String IPAddress::toString() const {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", _octets[0], _octets[1], _octets[2], _octets[3]);
+    return String(buffer);
+}
+
+bool Preferences::begin(const char* name, bool readOnly) {
+    _namespace = name;
+    _readOnly = readOnly;
+    return true;
+}
+
+bool Preferences::clear() {
+    if (_readOnly) return false;
+    std::lock_guard<std::mutex> lock(nvsMtx);
+    std::string prefix = _namespace + "/";
+    auto it = nvs().lower_bound(prefix);
+    while (it != nvs().end() && it->first.compare(0, prefix.length(), prefix) == 0) {
+        it = nvs().erase(it);
+    }
+    return true;
+}
+
+bool Preferences::remove(const char* key) {
+    if (_readOnly) return false;
+    std::lock_guard<std::mutex> lock(nvsMtx);
+    return nvs().erase(path(key)) > 0;
+}
+
+bool Preferences::isKey(const char* key) {
+    std::lock_guard<std::mutex> lock(nvsMtx);
+    return nvs().count(path(key)) > 0;
+}
+
+size_t Preferences::putString(const char* key, const char* value) {
+    if (_readOnly || !value) return 0;
+    std::lock_guard<std::mutex> lock(nvsMtx);
+    nvs()[path(key)] = value;
+    return strlen(value);
+}
+
+String Preferences::getString(const char* key, const String& defaultValue) {
+    std::lock_guard<std::mutex> lock(nvsMtx);
+    auto it = nvs().find(path(key));
+    return it == nvs().end() ? defaultValue : String(it->second);
+}
+
+size_t Preferences::putLong64(const char* key, int64_t value) {
+    if (_readOnly) return 0;
+    std::lock_guard<std::mutex> lock(nvsMtx);
+    nvs()[path(key)] = std::to_string(value);
+    return sizeof(value);
+}
+
+int64_t Preferences::getLong64(const char* key, int64_t defaultValue) {
+    std::lock_guard<std::mutex> lock(nvsMtx);
+    auto it = nvs().find(path(key));
+    return it == nvs().end() ? defaultValue : strtoll(it->second.c_str(), nullptr, 10);
+}
+
+int HTTPClient::gatewayResponder(const char* method, const String& uri, const uint8_t*, size_t, String& response) {
+    if (strcmp(method, "GET") == 0 && uri.endsWith("/gateway")) {
+        response = "{\"url\":\"wss://gateway.discord.gg\"}";
+        return HTTP_CODE_OK;
+    }
+    return HTTP_CODE_NO_CONTENT;
+}
+
+HTTPClient::Responder HTTPClient::responder = HTTPClient::gatewayResponder;
+std::atomic<unsigned long> HTTPClient::requests { 0 };
+
+bool HTTPClient::begin(const String& url, const char*) {
+    // Keep the path only, the same shape setURL() and the pooled begin() produce.
+    int scheme = url.indexOf("://");
+    int path = url.indexOf('/', scheme < 0 ? 0 : scheme + 3);
+    _uri = path < 0 ? String("/") : url.substring(path);
+    return true;
+}
+
+bool HTTPClient::begin(WiFiClient&, const String&, uint16_t, const String& uri, bool) {
+    _uri = uri;
+    return true;
+}
+
+bool HTTPClient::setURL(const String& url) {
+    if (url.startsWith("/")) {
+        _uri = url;
+        return true;
+    }
+    return begin(url);
+}
+
+int HTTPClient::sendRequest(const char* method, const uint8_t* payload, size_t size) {
+    ++requests;
+    _response.clear();
+    return responder ? responder(method, _uri, payload, size, _response) : HTTPC_ERROR_CONNECTION_REFUSED;
+}
+
+WebSocketsClient* WebSocketsClient::last = nullptr;
+
+void WebSocketsClient::begin(const String& host, uint16_t, const String& url, const String&) {
+    _host = host;
+    _url = url;
+}
+
+void WebSocketsClient::beginSSL(const String& host, uint16_t port, const String& url, const String&,
+    const String& protocol) {
+    begin(host, port, url, protocol);
+}
+
+void WebSocketsClient::disconnect() {
+    if (_connected) receive(WStype_DISCONNECTED);
+}
+
+bool WebSocketsClient::sendTXT(uint8_t* payload, size_t length, bool headerToPayload) {
+    if (!_connected) return false;
+    // With headerToPayload the caller left room for the frame header in front of the text.
+    const char* text = reinterpret_cast<const char*>(payload + (headerToPayload ? WEBSOCKETS_MAX_HEADER_SIZE : 0));
+    if (length == 0) length = strlen(text);
+
+    ++framesSent;
+    if (onSend) onSend(text, length);
+    return true;
+}
+
+void WebSocketsClient::hello(unsigned long heartbeatInterval) {
+    char frame[96];
+    int length = snprintf(frame, sizeof(frame), "{\"t\":null,\"s\":null,\"op\":10,\"d\":{\"heartbeat_interval\":%lu}}",
+        heartbeatInterval);
+    receive(WStype_TEXT, reinterpret_cast<uint8_t*>(frame), length);
+}
+
+void WebSocketsClient::receive(WStype_t type, uint8_t* payload, size_t length) {
+    if (type == WStype_CONNECTED) _connected = true;
+    else if (type == WStype_DISCONNECTED) _connected = false;
+    if (_event) _event(type, payload, length);
+}
@@ -0,0 +1,107 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <authorization.h>
+#include <log.h>
+#include <algorithm>
+
+#define AUTHORIZATION_MESSAGE_PREFIX "[AUTH] "
+
+namespace Authorization {
+    namespace {
+        // Copies up to capacity ids, then sorts them and drops duplicates. Returns how many are left.
+        template <typename T>
+        size_t fill(T* destination, size_t capacity, const T* source, size_t length, const char* kind) {
+            if (length > capacity) {
+                LOG_W(AUTHORIZATION_MESSAGE_PREFIX "Only the first %u %s are used.",
+                    static_cast<unsigned int>(capacity), kind);
+                length = capacity;
+            }
+            std::copy(source, source + length, destination);
+            std::sort(destination, destination + length);
+            return std::unique(destination, destination + length) - destination;
+        }
+
+        // Parses a whole signed decimal id, so "" and "123abc" don't count as chat 0 or 123
+        bool parseId(const char* text, int64_t& id) {
+            if (!text || !*text) return false;
+            char* end;
+            id = strtoll(text, &end, 10);
+            return *end == '\0';
+        }
+
+        bool ruleLess(const Rule& lhs, const Rule& rhs) {
+            return strcmp(lhs.command, rhs.command) < 0;
+        }
+    }
+
+    void Engine::begin(const Config& config) {
+        _usersLength = fill(_users, AUTHORIZATION_MAX_IDS, config.users, config.usersLength, "user ids");
+        _rolesLength = fill(_roles, AUTHORIZATION_MAX_IDS, config.roles, config.rolesLength, "role ids");
+
+        int64_t chats[AUTHORIZATION_MAX_IDS];
+        size_t chatsLength = 0;
+        for (size_t i = 0; i < config.telegramChatsLength && chatsLength < AUTHORIZATION_MAX_IDS; ++i) {
+            if (parseId(config.telegramChats[i], chats[chatsLength])) ++chatsLength;
+        }
+        _chatsLength = fill(_chats, AUTHORIZATION_MAX_IDS, chats, chatsLength, "chat ids");
+
+        _rulesLength = std::min(config.rulesLength, static_cast<size_t>(AUTHORIZATION_MAX_RULES));
+        if (_rulesLength < config.rulesLength) {
+            LOG_W(AUTHORIZATION_MESSAGE_PREFIX "Only the first %u rules are used.", AUTHORIZATION_MAX_RULES);
+        }
+        std::copy(config.rules, config.rules + _rulesLength, _rules);
+        std::sort(_rules, _rules + _rulesLength, ruleLess);
+        _defaultAllow = config.defaultAllow;
+    }
+
+    uint8_t Engine::policy(const char* command) const {
+        if (!command) return _defaultAllow;
+        Rule key { command, Nobody };
+        const Rule* rule = std::lower_bound(_rules, _rules + _rulesLength, key, ruleLess);
+        if (rule == _rules + _rulesLength || strcmp(rule->command, command) != 0) return _defaultAllow;
+        return rule->allow;
+    }
+
+    bool Engine::allowsDiscord(const char* command, uint64_t userId, JsonArrayConst roles) const {
+        uint8_t allow = policy(command);
+        if (allow == Everyone) return true;
+
+        if ((allow & Users) && std::binary_search(_users, _users + _usersLength, userId)) return true;
+        if ((allow & Roles) && _rolesLength) {
+            for (JsonVariantConst role : roles) {
+                if (std::binary_search(_roles, _roles + _rolesLength, role.as<uint64_t>())) return true;
+            }
+        }
+        return false;
+    }
+
+    bool Engine::allowsTelegram(const char* command, const char* chatId) const {
+        uint8_t allow = policy(command);
+        if (allow == Everyone) return true;
+
+        int64_t id;
+        return (allow & TelegramChats) && parseId(chatId, id) && std::binary_search(_chats, _chats + _chatsLength, id);
+    }
+
+    void Engine::report() const {
+        LOG_I(AUTHORIZATION_MESSAGE_PREFIX "%u user(s), %u role(s), %u Telegram chat(s), %u rule(s).",
+            static_cast<unsigned int>(_usersLength), static_cast<unsigned int>(_rolesLength),
+            static_cast<unsigned int>(_chatsLength), static_cast<unsigned int>(_rulesLength));
+    }
+}
@@ -0,0 +1,103 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <boot.h>
+#include <log.h>
+#include <WiFi.h>
+#include <atomic>
+
+#define BOOT_MESSAGE_PREFIX "[BOOT] "
+
+namespace Boot {
+    namespace {
+        const char* phaseNames[] = { "Wi-Fi", "DNS", "TLS", "HELLO", "READY" };
+        static_assert(sizeof(phaseNames) / sizeof(phaseNames[0]) == static_cast<size_t>(Phase::COUNT),
+            "Every boot phase needs a name");
+
+        std::atomic<unsigned long> phaseTimes[static_cast<size_t>(Phase::COUNT)];
+        std::atomic<size_t> pendingLookups { 0 };
+
+        void resolveTask(void* parameter) {
+            const char* host = static_cast<const char*>(parameter);
+            unsigned long start = millis();
+            IPAddress address;
+            if (WiFi.hostByName(host, address)) {
+                LOG_I(BOOT_MESSAGE_PREFIX "Resolved %s to %s in %lu ms.", host, address.toString(), millis() - start);
+            }
+            else {
+                LOG_W(BOOT_MESSAGE_PREFIX "Failed to resolve %s.", host);
+            }
+
+            if (pendingLookups.fetch_sub(1) == 1) {
+                mark(Phase::DNS);
+            }
+            vTaskDelete(nullptr);
+        }
+    }
+
+    void mark(Phase phase) {
+        unsigned long expected = 0;
+        // millis() is never 0 by the time anything here runs, so 0 doubles as "not reached".
+        phaseTimes[static_cast<size_t>(phase)].compare_exchange_strong(expected, millis());
+    }
+
+    unsigned long elapsed(Phase phase) {
+        return phaseTimes[static_cast<size_t>(phase)].load();
+    }
+
+    bool complete() {
+        for (size_t i = 0; i < static_cast<size_t>(Phase::COUNT); ++i) {
+            if (phaseTimes[i].load() == 0) return false;
+        }
+        return true;
+    }
+
+    void resolveHosts(const char* const* hosts, size_t count) {
+        if (count == 0) {
+            mark(Phase::DNS);
+            return;
+        }
+        pendingLookups = count;
+        for (size_t i = 0; i < count; ++i) {
+            if (xTaskCreate(resolveTask, "BootResolveTask", 3 * 1024, const_cast<char*>(hosts[i]),
+                tskIDLE_PRIORITY + 1, nullptr) != pdPASS) {
+                // Couldn't start this lookup; don't let it hold the phase open.
+                if (pendingLookups.fetch_sub(1) == 1) {
+                    mark(Phase::DNS);
+                }
+            }
+        }
+    }
+
+    void report() {
+        unsigned long previous = 0;
+        for (size_t i = 0; i < static_cast<size_t>(Phase::COUNT); ++i) {
+            unsigned long at = phaseTimes[i].load();
+            if (at == 0) {
+                LOG_I(BOOT_MESSAGE_PREFIX "%s: not reached", phaseNames[i]);
+            }
+            else if (at >= previous) {
+                LOG_I(BOOT_MESSAGE_PREFIX "%s: %lu ms (+%lu ms)", phaseNames[i], at, at - previous);
+                previous = at;
+            }
+            else {
+                LOG_I(BOOT_MESSAGE_PREFIX "%s: %lu ms", phaseNames[i], at);
+            }
+        }
+    }
+}
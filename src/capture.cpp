@@ -0,0 +1,90 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <capture.h>
+
+namespace Discord::Capture {
+    namespace {
+        const char tokenKey[] = "\"token\":\"";
+        const char redacted[] = "REDACTED";
+
+        // Where the next "token" value starts, or nullptr
+        const char* findToken(const char* from, const char* end) {
+            const size_t keyLength = sizeof(tokenKey) - 1;
+            for (const char* p = from; p + keyLength <= end; ++p) {
+                if (*p == '"' && memcmp(p, tokenKey, keyLength) == 0) return p + keyLength;
+            }
+            return nullptr;
+        }
+    }
+
+    void write(Print& out, unsigned long delta, Kind kind, const char* payload, size_t length) {
+        char header[32];
+        int headerLength = snprintf(header, sizeof(header), DISCORD_CAPTURE_PREFIX "%lu %c", delta, static_cast<char>(kind));
+        out.write(reinterpret_cast<const uint8_t*>(header), headerLength);
+
+        if (payload && length) {
+            out.write(' ');
+            // Copy the payload around each token value rather than into a scratch buffer, since frames can be large.
+            const char* end = payload + length;
+            const char* from = payload;
+            const char* value;
+            while ((value = findToken(from, end)) != nullptr) {
+                out.write(reinterpret_cast<const uint8_t*>(from), value - from);
+                out.write(reinterpret_cast<const uint8_t*>(redacted), sizeof(redacted) - 1);
+                // Tokens are base64 and dots, never escaped quotes
+                from = static_cast<const char*>(memchr(value, '"', end - value));
+                if (!from) from = end;
+            }
+            out.write(reinterpret_cast<const uint8_t*>(from), end - from);
+        }
+        out.write('\n');
+    }
+
+    bool parse(const char* line, size_t length, Record& record) {
+        const char* end = line + length;
+        while (end > line && (end[-1] == '\n' || end[-1] == '\r')) --end;
+
+        const size_t prefixLength = sizeof(DISCORD_CAPTURE_PREFIX) - 1;
+        if (static_cast<size_t>(end - line) >= prefixLength && memcmp(line, DISCORD_CAPTURE_PREFIX, prefixLength) == 0) {
+            line += prefixLength;
+        }
+
+        char* afterDelta;
+        record.delta = strtoul(line, &afterDelta, 10);
+        if (afterDelta == line || afterDelta + 2 > end || *afterDelta != ' ') return false;
+
+        switch (afterDelta[1]) {
+            case 'R':
+            case 'S':
+            case 'C':
+            case 'D':
+                record.kind = static_cast<Kind>(afterDelta[1]);
+                break;
+            default:
+                return false;
+        }
+
+        const char* payload = afterDelta + 2;
+        if (payload < end && *payload == ' ') ++payload;
+        record.payload = payload;
+        record.length = end - payload;
+        return true;
+    }
+}
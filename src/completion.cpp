@@ -0,0 +1,61 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <completion.h>
+#include <log.h>
+#include <algorithm>
+#include <strings.h>
+
+#define COMPLETION_MESSAGE_PREFIX "[DISCORD][AUTOCOMPLETE] "
+
+namespace Discord {
+    void CompletionIndex::begin(const char* const* values, size_t length) {
+        _length = 0;
+        for (size_t i = 0; i < length; ++i) {
+            const char* value = values[i];
+            if (!value || !*value || strlen(value) > DISCORD_AUTOCOMPLETE_CHOICE_SIZE || strpbrk(value, "\"\\")) {
+                LOG_W(COMPLETION_MESSAGE_PREFIX "Value %s can't be suggested, skipped.", value ? value : "(null)");
+                continue;
+            }
+            if (_length == DISCORD_COMPLETION_VALUES) {
+                LOG_W(COMPLETION_MESSAGE_PREFIX "Only the first %u values are suggested.",
+                    static_cast<unsigned int>(DISCORD_COMPLETION_VALUES));
+                break;
+            }
+            _values[_length++] = value;
+        }
+        std::sort(_values, _values + _length, [](const char* lhs, const char* rhs) {
+            return strcasecmp(lhs, rhs) < 0;
+        });
+    }
+
+    size_t CompletionIndex::complete(const char* prefix, const char** out, size_t capacity) const {
+        if (!prefix) prefix = "";
+        size_t prefixLength = strlen(prefix);
+        // The first value not below the prefix is the first that can start with it
+        const char* const* value = std::lower_bound(_values, _values + _length, prefix,
+            [](const char* lhs, const char* rhs) { return strcasecmp(lhs, rhs) < 0; });
+
+        size_t count = 0;
+        for (; value != _values + _length && count < capacity; ++value) {
+            if (strncasecmp(*value, prefix, prefixLength) != 0) break;
+            out[count++] = *value;
+        }
+        return count;
+    }
+}
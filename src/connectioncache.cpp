@@ -0,0 +1,139 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <connectioncache.h>
+#include <log.h>
+
+#define DISCORD_MESSAGE_PREFIX "[DISCORD] "
+
+namespace Discord {
+    ConnectionCache connectionCache;
+
+    ConnectionCache::Lease::Lease(ConnectionCache* cache, size_t index, bool reused) :
+        _cache { cache }, _index { index }, _reused { reused } {}
+
+    ConnectionCache::Lease::Lease(Lease&& other) :
+        _cache { other._cache }, _index { other._index }, _reused { other._reused } {
+        other._cache = nullptr;
+    }
+
+    ConnectionCache::Lease::~Lease() {
+        if (_cache) _cache->release(_index);
+    }
+
+    HTTPClient& ConnectionCache::Lease::http() {
+        return _cache->_entries[_index].http;
+    }
+
+    ConnectionCache::ConnectionCache() {
+        _tableMtx = xSemaphoreCreateMutex();
+        for (Entry& entry : _entries) {
+            entry.mtx = xSemaphoreCreateMutex();
+            // Matches HTTPClient::begin(url, nullptr), which the callers used before.
+            entry.secureClient.setInsecure();
+            entry.http.setReuse(true);
+        }
+    }
+
+    ConnectionCache::Lease ConnectionCache::acquire(const char* host, uint16_t port, bool secure, TickType_t wait) {
+        for (;;) {
+            xSemaphoreTake(_tableMtx, portMAX_DELAY);
+
+            size_t index = DISCORD_CONNECTION_CACHE_SIZE;
+            for (size_t i = 0; i < DISCORD_CONNECTION_CACHE_SIZE; ++i) {
+                if (_entries[i].port == port && _entries[i].secure == secure && strcmp(_entries[i].host, host) == 0) {
+                    index = i;
+                    break;
+                }
+            }
+
+            if (index == DISCORD_CONNECTION_CACHE_SIZE) {
+                // Not cached: take an unused slot, otherwise the least recently used one.
+                index = 0;
+                for (size_t i = 0; i < DISCORD_CONNECTION_CACHE_SIZE; ++i) {
+                    if (_entries[i].port == 0) {
+                        index = i;
+                        break;
+                    }
+                    if (static_cast<long>(_entries[i].lastUsed - _entries[index].lastUsed) < 0) index = i;
+                }
+
+                // Holders only ever give the entry back, so waiting under the table lock can't deadlock.
+                Entry& entry = _entries[index];
+                if (xSemaphoreTake(entry.mtx, wait) != pdTRUE) {
+                    xSemaphoreGive(_tableMtx);
+                    return Lease(nullptr, 0, false);
+                }
+                if (entry.port != 0) {
+                    LOG_I(DISCORD_MESSAGE_PREFIX "Closing cached connection to %s", entry.host);
+                    entry.client().stop();
+                }
+                strlcpy(entry.host, host, sizeof(entry.host));
+                entry.port = port;
+                entry.secure = secure;
+                entry.http.begin(entry.client(), host, port, "/", secure);
+                xSemaphoreGive(_tableMtx);
+
+                ++_misses;
+                return Lease(this, index, false);
+            }
+            xSemaphoreGive(_tableMtx);
+
+            Entry& entry = _entries[index];
+            if (xSemaphoreTake(entry.mtx, wait) != pdTRUE) return Lease(nullptr, 0, false);
+            if (entry.port != port || entry.secure != secure || strcmp(entry.host, host) != 0) {
+                // Handed to another host while we waited; look again.
+                xSemaphoreGive(entry.mtx);
+                continue;
+            }
+
+            bool reused = entry.client().connected();
+            if (reused) {
+                ++_hits;
+            }
+            else {
+                ++_misses;
+            }
+            return Lease(this, index, reused);
+        }
+    }
+
+    void ConnectionCache::release(size_t index) {
+        _entries[index].lastUsed = millis();
+        xSemaphoreGive(_entries[index].mtx);
+    }
+
+    void ConnectionCache::expire(unsigned long idleTimeout) {
+        unsigned long now = millis();
+        for (Entry& entry : _entries) {
+            if (entry.port == 0 || now - entry.lastUsed < idleTimeout) continue;
+            if (xSemaphoreTake(entry.mtx, 0) != pdTRUE) continue;
+            if (entry.client().connected()) {
+                entry.client().stop();
+            }
+            xSemaphoreGive(entry.mtx);
+        }
+    }
+
+    void ConnectionCache::logStats() const {
+        uint32_t hits = _hits.load();
+        uint32_t misses = _misses.load();
+        LOG_I(DISCORD_MESSAGE_PREFIX "Connection cache: %u reused, %u new handshakes (%lu%% hit rate)",
+            hits, misses, hits + misses > 0 ? 100UL * hits / (hits + misses) : 0UL);
+    }
+}
@@ -17,204 +17,998 @@
  */
 
 #include <discord.h>
+#include <connectioncache.h>
+#include <log.h>
+#include <trace.h>
+#include <WiFi.h>
+#include <Preferences.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <esp_attr.h>
+#include <esp_heap_caps.h>
+#include <esp_system.h>
+#include <stdarg.h>
+#include <sys/time.h>
 
 #define DISCORD_MESSAGE_PREFIX "[DISCORD] "
+#define DISCORD_RESUME_STATE_MAGIC 0x5245534DUL
 
 namespace Discord {
+    namespace {
+        // Survives a software restart, but not a power cycle or brownout.
+        struct ResumeState {
+            uint32_t magic;
+            uint32_t sequence;
+            int64_t savedAt;
+            char sessionId[64];
+            char gatewayURL[96];
+            uint32_t checksum;
+        };
+
+        RTC_NOINIT_ATTR ResumeState resumeState;
+
+        uint32_t resumeStateChecksum(const ResumeState& state) {
+            // FNV-1a over everything but the checksum itself
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&state);
+            uint32_t hash = 2166136261UL;
+            for (size_t i = 0; i < offsetof(ResumeState, checksum); ++i) {
+                hash = (hash ^ bytes[i]) * 16777619UL;
+            }
+            return hash;
+        }
+
+        int64_t secondsNow() {
+            // The system clock keeps counting across software restarts.
+            struct timeval tv;
+            gettimeofday(&tv, nullptr);
+            return tv.tv_sec;
+        }
+
+        // Anything earlier means the clock has not been set since power-on.
+        bool clockIsSet(int64_t seconds) {
+            return seconds > 1600000000LL;
+        }
+
+        // Every request to Discord's REST API shares the cached connection, so it costs one TLS session.
+        ConnectionCache::Lease acquireRest(TickType_t wait = portMAX_DELAY) {
+            return connectionCache.acquire(DISCORD_API_HOSTNAME, DISCORD_API_PORT, DISCORD_API_SECURE, wait);
+        }
+
+        // Drops the scheme from a gateway URL; the socket takes the host alone.
+        const char* stripScheme(const char* url) {
+            if (!url) return "";
+            const char* host = strstr(url, "://");
+            return host ? host + 3 : url;
+        }
+
+        String loadCachedGatewayURL() {
+            Preferences prefs;
+            if (!prefs.begin("discord", true)) return String();
+            String url = prefs.getString("gwUrl", "");
+            int64_t savedAt = prefs.getLong64("gwAt", 0);
+            // A URL handed out by another API host (say, the simulator) is no use here.
+            bool sameHost = prefs.getString("gwApi", "") == DISCORD_HOST;
+            prefs.end();
+
+            if (!sameHost) return String();
+
+            // Without a set clock the age can't be judged; the URL is dropped anyway if it fails to connect.
+            int64_t now = secondsNow();
+            if (clockIsSet(now) && clockIsSet(savedAt) && now - savedAt > static_cast<int64_t>(DISCORD_GATEWAY_CACHE_TTL)) {
+                return String();
+            }
+            return url;
+        }
+
+        void storeGatewayURL(const String& url) {
+            Preferences prefs;
+            if (!prefs.begin("discord", false)) return;
+            // Only write when something changed, to spare the flash.
+            if (prefs.getString("gwUrl", "") != url) {
+                prefs.putString("gwUrl", url);
+            }
+            if (prefs.getString("gwApi", "") != DISCORD_HOST) {
+                prefs.putString("gwApi", DISCORD_HOST);
+            }
+            int64_t now = secondsNow();
+            if (clockIsSet(now)) {
+                prefs.putLong64("gwAt", now);
+            }
+            prefs.end();
+        }
+
+        void clearCachedGatewayURL() {
+            Preferences prefs;
+            if (!prefs.begin("discord", false)) return;
+            prefs.clear();
+            prefs.end();
+        }
+
+        struct DispatchName {
+            const char* name;
+            Bot::Event event;
+        };
+
+        // Sorted by name, for a binary search in Bot::dispatchEvent()
+        const DispatchName dispatchNames[] = {
+        { "APPLICATION_COMMAND_PERMISSIONS_UPDATE", Bot::Event::ApplicationCommandPermissionsUpdate },
+        { "AUTO_MODERATION_ACTION_EXECUTION", Bot::Event::AutoModerationRuleExecution },
+        { "AUTO_MODERATION_RULE_CREATE", Bot::Event::AutoModerationRuleCreate },
+        { "AUTO_MODERATION_RULE_DELETE", Bot::Event::AutoModerationRuleDelete },
+        { "AUTO_MODERATION_RULE_UPDATE", Bot::Event::AutoModerationRuleUpdate },
+        { "CHANNEL_CREATE", Bot::Event::ChannelCreate },
+        { "CHANNEL_DELETE", Bot::Event::ChannelDelete },
+        { "CHANNEL_PINS_UPDATE", Bot::Event::ChannelPinsUpdate },
+        { "CHANNEL_UPDATE", Bot::Event::ChannelUpdate },
+        { "GUILD_AUDIT_LOG_ENTRY_CREATE", Bot::Event::GuildAuditLogEntryCreate },
+        { "GUILD_BAN_ADD", Bot::Event::GuildBanAdd },
+        { "GUILD_BAN_REMOVE", Bot::Event::GuildBanRemove },
+        { "GUILD_CREATE", Bot::Event::GuildCreate },
+        { "GUILD_DELETE", Bot::Event::GuildDelete },
+        { "GUILD_EMOJIS_UPDATE", Bot::Event::GuildEmojisUpdate },
+        { "GUILD_INTEGRATIONS_UPDATE", Bot::Event::GuildIntegrationsUpdate },
+        { "GUILD_MEMBERS_CHUNK", Bot::Event::GuildMembersChunk },
+        { "GUILD_MEMBER_ADD", Bot::Event::GuildMemberAdd },
+        { "GUILD_MEMBER_REMOVE", Bot::Event::GuildMemberRemove },
+        { "GUILD_MEMBER_UPDATE", Bot::Event::GuildMemberUpdate },
+        { "GUILD_ROLE_CREATE", Bot::Event::GuildRoleCreate },
+        { "GUILD_ROLE_DELETE", Bot::Event::GuildRoleDelete },
+        { "GUILD_ROLE_UPDATE", Bot::Event::GuildRoleUpdate },
+        { "GUILD_SCHEDULED_EVENT_CREATE", Bot::Event::GuildScheduledEventCreate },
+        { "GUILD_SCHEDULED_EVENT_DELETE", Bot::Event::GuildScheduledEventDelete },
+        { "GUILD_SCHEDULED_EVENT_UPDATE", Bot::Event::GuildScheduledEventUpdate },
+        { "GUILD_SCHEDULED_EVENT_USER_ADD", Bot::Event::GuildScheduledEventUserAdd },
+        { "GUILD_SCHEDULED_EVENT_USER_REMOVE", Bot::Event::GuildScheduledEventUserRemove },
+        { "GUILD_STICKERS_UPDATE", Bot::Event::GuildStickersUpdate },
+        { "GUILD_UPDATE", Bot::Event::GuildUpdate },
+        { "INTEGRATION_CREATE", Bot::Event::IntegrationCreate },
+        { "INTEGRATION_DELETE", Bot::Event::IntegrationDelete },
+        { "INTEGRATION_UPDATE", Bot::Event::IntegrationUpdate },
+        { "INTERACTION_CREATE", Bot::Event::InteractionCreate },
+        { "INVITE_CREATE", Bot::Event::InviteCreate },
+        { "INVITE_DELETE", Bot::Event::InviteDelete },
+        { "MESSAGE_CREATE", Bot::Event::MessageCreate },
+        { "MESSAGE_DELETE", Bot::Event::MessageDelete },
+        { "MESSAGE_DELETE_BULK", Bot::Event::MessageDeleteBulk },
+        { "MESSAGE_REACTION_ADD", Bot::Event::MessageReactionAdd },
+        { "MESSAGE_REACTION_REMOVE", Bot::Event::MessageReactionRemove },
+        { "MESSAGE_REACTION_REMOVE_ALL", Bot::Event::MessageReactionRemoveAll },
+        { "MESSAGE_REACTION_REMOVE_EMOJI", Bot::Event::MessageReactionRemoveEmoji },
+        { "MESSAGE_UPDATE", Bot::Event::MessageUpdate },
+        { "PRESENCE_UPDATE", Bot::Event::PresenceUpdate },
+        { "READY", Bot::Event::Ready },
+        { "RESUMED", Bot::Event::Resumed },
+        { "STAGE_INSTANCE_CREATE", Bot::Event::StageInstanceCreate },
+        { "STAGE_INSTANCE_DELETE", Bot::Event::StageInstanceDelete },
+        { "STAGE_INSTANCE_UPDATE", Bot::Event::StageInstanceUpdate },
+        { "THREAD_CREATE", Bot::Event::ThreadCreate },
+        { "THREAD_DELETE", Bot::Event::ThreadDelete },
+        { "THREAD_LIST_SYNC", Bot::Event::ThreadListSync },
+        { "THREAD_MEMBERS_UPDATE", Bot::Event::ThreadMembersUpdate },
+        { "THREAD_MEMBER_UPDATE", Bot::Event::ThreadMemberUpdate },
+        { "THREAD_UPDATE", Bot::Event::ThreadUpdate },
+        { "TYPING_START", Bot::Event::TypingStart },
+        { "USER_UPDATE", Bot::Event::UserUpdate },
+        { "VOICE_SERVER_UPDATE", Bot::Event::VoiceServerUpdate },
+        { "VOICE_STATE_UPDATE", Bot::Event::VoiceStateUpdate },
+        { "WEBHOOKS_UPDATE", Bot::Event::WebhooksUpdate },
+        };
+
+        const char* dispatchName(Bot::Event event) {
+            for (const DispatchName& entry : dispatchNames) {
+                if (entry.event == event) return entry.name;
+            }
+            return "?";
+        }
+    }
+
+    static_assert(static_cast<size_t>(Bot::Event::WebhooksUpdate) < 128, "Bot::_subscribedEvents is too small");
 
     Bot::Bot(const char* botToken, uint64_t applicationId, bool enableRateLimit) :
         _botToken { botToken }, _applicationId { applicationId }, _rateLimit { enableRateLimit } {
-        _httpsMtx = xSemaphoreCreateMutex();
+        _presenceMtx = xSemaphoreCreateMutex();
+        _sessionMtx = xSemaphoreCreateMutex();
+        _authorization = "Bot ";
+        _authorization += botToken;
     }
 
     void Bot::login(unsigned int intents) {
-        _https.begin(DISCORD_HOST, nullptr);
+        startResponder();
+        if (_sessionId.isEmpty()) {
+            restoreResumeState();
+        }
+
+        _state = ConnectionState::CONNECTING;
+        // Stamped by the next update(), as _now may be stale if login() is called directly
+        _attemptStartedAt = 0;
+        // Resume on the URL READY gave, or identify on the one from Get Gateway
+        _resuming = !_sessionId.isEmpty() && !_resumeURL.isEmpty();
+        if (!_resuming) {
+            xSemaphoreTake(_sessionMtx, portMAX_DELAY);
+            _sessionId.clear();
+            xSemaphoreGive(_sessionMtx);
+        }
+
+        _gatewayFromCache = false;
+        if (!_resuming && _gatewayURL.isEmpty()) {
+            // Skip the Get Gateway round trip on boot if a recent URL is in NVS.
+            _gatewayURL = loadCachedGatewayURL();
+            if (!_gatewayURL.isEmpty()) {
+                _gatewayFromCache = true;
+                LOG_I(DISCORD_MESSAGE_PREFIX "Gateway URL loaded from cache: %s", _gatewayURL);
+            }
+        }
+
         //Establish a connection with the Gateway after fetching and caching a WSS URL using the Get Gateway endpoint.
-        if (_gatewayURL.isEmpty()) {
+        if (!_resuming && _gatewayURL.isEmpty()) {
             StaticJsonDocument<64> doc;
-            if (sendRest<64>(_https, "GET", DISCORD_API_URI "/gateway", "", "", &doc)) {
-                _gatewayURL = doc["url"].as<const char*>() + 6; // Remove the 'wss://' prefix
-                Serial.print(DISCORD_MESSAGE_PREFIX "Gateway URL set to ");
-                Serial.println(_gatewayURL);
+            bool success;
+            {
+                ConnectionCache::Lease connection = acquireRest();
+                success = sendRest<64>(connection.http(), "GET", DISCORD_API_URI "/gateway", "", "", &doc);
             }
-            else {
-#ifdef ESP32
-                log_e(DISCORD_MESSAGE_PREFIX "Failed to set Gateway URL.");
-#else
-                Serial.println(DISCORD_MESSAGE_PREFIX "Failed to set Gateway URL.");
-#endif
+            if (!success) {
+                connectionLost("Failed to set Gateway URL.", true);
                 return;
             }
+            _gatewayURL = stripScheme(doc["url"].as<const char*>());
+            storeGatewayURL(_gatewayURL);
+            LOG_I(DISCORD_MESSAGE_PREFIX "Gateway URL set to %s", _gatewayURL);
         }
 
         _socket.onEvent([=](WStype_t type, uint8_t* payload, size_t length) {
             this->onWebSocketEvents(type, payload, length);
             });
-        Serial.print(DISCORD_MESSAGE_PREFIX "Attempting connection via WebSocket to ");
-        Serial.println(_gatewayURL);
-        _socket.beginSSL(_gatewayURL, 443, DISCORD_GATEWAY_SUFFIX);
+        const String& url = _resuming ? _resumeURL : _gatewayURL;
+        LOG_I(DISCORD_MESSAGE_PREFIX "Attempting connection via WebSocket to %s", url);
+#if DISCORD_GATEWAY_SECURE
+        _socket.beginSSL(url, DISCORD_GATEWAY_PORT, DISCORD_GATEWAY_SUFFIX);
+#else
+        _socket.begin(url, DISCORD_GATEWAY_PORT, DISCORD_GATEWAY_SUFFIX);
+#endif
 
-        _intents = intents;
+        _intents = resolveIntents(intents);
         _heartbeatInterval = 0;
         _lastHeartbeatAck = 0;
         _lastHeartbeatSend = 0;
     }
 
+    bool Bot::begin(unsigned int intents, BaseType_t gatewayCore, BaseType_t workerCore) {
+        if (_gatewayTask) return true;
+
+        _intents = resolveIntents(intents);
+        if (!startResponder()) return false;
+
+        // The worker runs at the same priority as the gateway task, so a slow handler can never delay a heartbeat.
+        if (xTaskCreatePinnedToCore(interactionTask, "DiscordInteractionTask", 8 * 1024, this,
+            tskIDLE_PRIORITY + 1, &_interactionTask, workerCore) != pdPASS) {
+            LOG_E(DISCORD_MESSAGE_PREFIX "Failed to start interaction task.");
+            _interactionTask = nullptr;
+            return false;
+        }
+        if (xTaskCreatePinnedToCore(gatewayTask, "DiscordGatewayTask", 8 * 1024, this,
+            tskIDLE_PRIORITY + 1, &_gatewayTask, gatewayCore) != pdPASS) {
+            LOG_E(DISCORD_MESSAGE_PREFIX "Failed to start gateway task.");
+            return false;
+        }
+        return true;
+    }
+
+    bool Bot::warmUp() {
+        StaticJsonDocument<64> doc;
+        bool success;
+        {
+            ConnectionCache::Lease connection = acquireRest();
+            success = sendRest<64>(connection.http(), "GET", DISCORD_API_URI "/gateway", "", "", &doc);
+        }
+
+        const char* url = doc["url"];
+        if (success && url) {
+            storeGatewayURL(stripScheme(url));
+        }
+        return success;
+    }
+
+    void Bot::gatewayTask(void* parameter) {
+        Bot* bot = static_cast<Bot*>(parameter);
+
+        for (;;) {
+            unsigned long now = millis();
+            bot->update(now);
+            if (bot->_state == ConnectionState::DISCONNECTED && WiFi.isConnected()
+                && static_cast<long>(now - bot->_nextLoginAttempt) >= 0) {
+                bot->login(bot->_intents);
+            }
+            vTaskDelay(1);
+        }
+    }
+
+    void Bot::interactionTask(void* parameter) {
+        Bot* bot = static_cast<Bot*>(parameter);
+        GatewayEvent event;
+
+        for (;;) {
+            // Woken by the gateway task after each push; drain everything that has arrived since.
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            while (bot->_events.pop(event)) {
+                if (event.type == Event::InteractionCreate) {
+                    bot->handleInteraction((*event.frame)[bot->_d].as<JsonObject>());
+                }
+                else if (event.type == Event::MessageCreate) {
+                    bot->handleTextCommand((*event.frame)[bot->_d].as<JsonObject>());
+                }
+                delete event.frame;
+            }
+        }
+    }
+
     void Bot::update(unsigned long now) {
         _now = now;
+        // Left alone between attempts, so the socket doesn't reconnect by itself ahead of the backoff
+        if (_state == ConnectionState::DISCONNECTED) return;
+
         _socket.loop();
         _online = _socket.isConnected();
-        if (!_online && !_gatewayURL.isEmpty()) {
-            //Clear gateway/resume URL cache
-            _gatewayURL.clear();
+        if (_attemptStartedAt == 0) _attemptStartedAt = now;
+        if (_state != ConnectionState::READY && now - _attemptStartedAt > DISCORD_HANDSHAKE_TIMEOUT) {
+            connectionLost("Timed out connecting to the gateway.", true);
             return;
         }
 
         if (_rateLimit && now - _lastRateReset > 60000) {
-            // Serial.print("[DISCORD] Rate limit reset. Sent last minute: ");
-            // Serial.println(_eventsSent);
+            // LOG_D(DISCORD_MESSAGE_PREFIX "Rate limit reset. Sent last minute: %u", _eventsSent);
             _eventsSent = 0;
             _lastRateReset = now;
         }
+        // The presence budget holds with or without rate limiting, so it runs on a window of its own.
+        if (now - _lastPresenceBudgetReset > 60000) {
+            _presenceSentThisMinute = 0;
+            _lastPresenceBudgetReset = now;
+        }
+
+        updatePresence();
+
+        if (_unackedHeartbeats > 0 && static_cast<long>(_now - _heartbeatsSentAt[0]) > static_cast<long>(ackTimeout())) {
+            ++_zombieConnections;
+            LOG_W(DISCORD_MESSAGE_PREFIX "Heartbeat not acknowledged within %lu ms (RTT %lu ms, variance %lu ms).",
+                ackTimeout(), _srtt, _rttvar);
+            connectionLost("Zombie connection.", true);
+            return;
+        }
 
         if (_heartbeatInterval > 0 && _now > (_firstHeartbeat > 0 ? _lastHeartbeatSend + _firstHeartbeat : _lastHeartbeatSend + _heartbeatInterval)) {
             heartbeat();
             _firstHeartbeat = 0;
         }
+    }
 
-        if (_lastHeartbeatAck > _lastHeartbeatSend + (_heartbeatInterval / 2))
-        {
-#ifdef ESP32
-            log_w(DISCORD_MESSAGE_PREFIX "Heartbeat acknowledgement timeout!");
-#else
-            Serial.println(DISCORD_MESSAGE_PREFIX "Heartbeat acknowledgement timeout!");
-#endif
-            logout();
+    unsigned long Bot::ackTimeout() const {
+        unsigned long timeout = _rttMeasured ? _srtt + 4 * _rttvar : DISCORD_ACK_TIMEOUT_INITIAL;
+        if (timeout < DISCORD_ACK_TIMEOUT_MIN) timeout = DISCORD_ACK_TIMEOUT_MIN;
+        // By the next heartbeat Discord would consider the connection dead anyway
+        if (_heartbeatInterval > 0 && timeout > _heartbeatInterval) timeout = _heartbeatInterval;
+        return timeout;
+    }
+
+    void Bot::connectionLost(const char* reason, bool resumable) {
+        // Closing the socket below reports DISCONNECTED again
+        if (_state == ConnectionState::DISCONNECTED) return;
+        LOG_W(DISCORD_MESSAGE_PREFIX "%s", reason);
+
+        bool wasReady = _state == ConnectionState::READY;
+        _state = ConnectionState::DISCONNECTED;
+        _online = false;
+        _ready = false;
+        _heartbeatInterval = 0;
+        _unackedHeartbeats = 0;
+        _untrackedAcks = 0;
+
+        if (wasReady) {
+            _reconnecting = true;
+            _outageStartedAt = _now;
         }
+        else {
+            ++_failedAttempts;
+            if (_resuming && ++_failedResumes >= DISCORD_RESUME_ATTEMPTS) {
+                LOG_I(DISCORD_MESSAGE_PREFIX "Resume failed %u times, identifying instead.", _failedResumes);
+                resumable = false;
+            }
+        }
+        if (!resumable) {
+            xSemaphoreTake(_sessionMtx, portMAX_DELAY);
+            _sessionId.clear();
+            _resumeURL.clear();
+            xSemaphoreGive(_sessionMtx);
+            _failedResumes = 0;
+        }
+
+        _socket.disconnect();
+        unsigned long wait = reconnectDelay();
+        _nextLoginAttempt = _now + wait;
+        LOG_I(DISCORD_MESSAGE_PREFIX "Reconnecting in %lu ms to %s.", wait, _sessionId.isEmpty() ? "identify" : "resume");
+    }
+
+    void Bot::connected(bool resumed) {
+        _state = ConnectionState::READY;
+        if (_reconnecting) {
+            _reconnecting = false;
+            _lastReconnectTime = _now - _outageStartedAt;
+            if (_lastReconnectTime > _maxReconnectTime) _maxReconnectTime = _lastReconnectTime;
+            ++_reconnects;
+            if (resumed) ++_resumedReconnects;
+            LOG_I(DISCORD_MESSAGE_PREFIX "Reconnected in %lu ms after %u failed attempts.", _lastReconnectTime,
+                _failedAttempts);
+        }
+        _failedAttempts = 0;
+        _failedResumes = 0;
+    }
+
+    unsigned long Bot::reconnectDelay() {
+        unsigned long ceiling = DISCORD_RECONNECT_BASE_DELAY;
+        for (uint8_t i = 0; i < _failedAttempts && ceiling < DISCORD_RECONNECT_MAX_DELAY; ++i) {
+            ceiling *= 2;
+        }
+        if (ceiling > DISCORD_RECONNECT_MAX_DELAY) ceiling = DISCORD_RECONNECT_MAX_DELAY;
+        // The first retry after a working connection may go straight away; later ones wait at least half the ceiling.
+        if (_failedAttempts == 0) return random(0, ceiling);
+        return ceiling / 2 + random(0, ceiling / 2);
     }
 
     void Bot::logout() {
         if (_socket.isConnected()) {
+            // Set first, so the DISCONNECTED event doesn't schedule a reconnect
+            _state = ConnectionState::DISCONNECTED;
+            _ready = false;
             _socket.disconnect();
             _online = false;
+            xSemaphoreTake(_sessionMtx, portMAX_DELAY);
             _sessionId.clear();
-            Serial.println(DISCORD_MESSAGE_PREFIX "Logout complete.");
+            _resumeURL.clear();
+            xSemaphoreGive(_sessionMtx);
+            LOG_I(DISCORD_MESSAGE_PREFIX "Logout complete.");
         }
-        _https.end();
+    }
+
+    bool Bot::saveResumeState() {
+        // Usually called from loop() while the gateway task may be replacing or clearing the session.
+        xSemaphoreTake(_sessionMtx, portMAX_DELAY);
+        if (!_ready || _sessionId.isEmpty() || _resumeURL.isEmpty()) {
+            xSemaphoreGive(_sessionMtx);
+            LOG_I(DISCORD_MESSAGE_PREFIX "No session to save for resuming.");
+            return false;
+        }
+
+        memset(&resumeState, 0, sizeof(resumeState));
+        resumeState.magic = DISCORD_RESUME_STATE_MAGIC;
+        resumeState.sequence = _lastSocketSequence;
+        resumeState.savedAt = secondsNow();
+        strlcpy(resumeState.sessionId, _sessionId.c_str(), sizeof(resumeState.sessionId));
+        strlcpy(resumeState.gatewayURL, _resumeURL.c_str(), sizeof(resumeState.gatewayURL));
+        resumeState.checksum = resumeStateChecksum(resumeState);
+        xSemaphoreGive(_sessionMtx);
+
+        LOG_I(DISCORD_MESSAGE_PREFIX "Session saved for resuming. Sequence: %u", _lastSocketSequence);
+        return true;
+    }
+
+    bool Bot::restoreResumeState() {
+        if (resumeState.magic != DISCORD_RESUME_STATE_MAGIC) return false;
+
+        bool valid = resumeState.checksum == resumeStateChecksum(resumeState)
+            && esp_reset_reason() == ESP_RST_SW;
+        int64_t age = secondsNow() - resumeState.savedAt;
+        valid = valid && age >= 0 && age <= DISCORD_RESUME_STATE_MAX_AGE;
+
+        // One attempt only; a failed resume falls back to identify through INVALID_SESSION.
+        resumeState.magic = 0;
+        if (!valid) {
+            LOG_I(DISCORD_MESSAGE_PREFIX "Saved session is stale, identifying instead.");
+            return false;
+        }
+
+        xSemaphoreTake(_sessionMtx, portMAX_DELAY);
+        _sessionId = resumeState.sessionId;
+        _lastSocketSequence = resumeState.sequence;
+        _resumeURL = resumeState.gatewayURL;
+        xSemaphoreGive(_sessionMtx);
+        LOG_I(DISCORD_MESSAGE_PREFIX "Restored session saved %lds ago, resuming.", static_cast<long>(age));
+        return true;
     }
 
     void Bot::onEvent(const EventCallback& cb) {
         _outerCallback = cb;
+        _subscribedEvents.set();
+    }
+
+    void Bot::onEvent(const EventCallback& cb, std::initializer_list<Event> events) {
+        _outerCallback = cb;
+        _subscribedEvents.reset();
+        for (Event event : events) {
+            _subscribedEvents.set(static_cast<size_t>(event));
+        }
+    }
+
+    unsigned int Bot::intentsFor(Event type) {
+        using namespace Intents;
+        switch (type) {
+            case Event::ChannelCreate:
+            case Event::ChannelUpdate:
+            case Event::ChannelDelete:
+            case Event::ChannelPinsUpdate:
+            case Event::ThreadCreate:
+            case Event::ThreadUpdate:
+            case Event::ThreadDelete:
+            case Event::ThreadListSync:
+            case Event::ThreadMemberUpdate:
+            case Event::GuildCreate:
+            case Event::GuildUpdate:
+            case Event::GuildDelete:
+            case Event::GuildRoleCreate:
+            case Event::GuildRoleUpdate:
+            case Event::GuildRoleDelete:
+            case Event::StageInstanceCreate:
+            case Event::StageInstanceUpdate:
+            case Event::StageInstanceDelete:
+                return GUILDS;
+            case Event::GuildMemberAdd:
+            case Event::GuildMemberRemove:
+            case Event::GuildMemberUpdate:
+            case Event::ThreadMembersUpdate:
+                return GUILD_MEMBERS;
+            case Event::GuildAuditLogEntryCreate:
+            case Event::GuildBanAdd:
+            case Event::GuildBanRemove:
+                return GUILD_MODERATION;
+            case Event::GuildEmojisUpdate:
+            case Event::GuildStickersUpdate:
+                return GUILD_EMOJIS_AND_STICKERS;
+            case Event::GuildIntegrationsUpdate:
+            case Event::IntegrationCreate:
+            case Event::IntegrationUpdate:
+            case Event::IntegrationDelete:
+                return GUILD_INTEGRATIONS;
+            case Event::WebhooksUpdate:
+                return GUILD_WEBHOOKS;
+            case Event::InviteCreate:
+            case Event::InviteDelete:
+                return GUILD_INVITES;
+            case Event::VoiceStateUpdate:
+                return GUILD_VOICE_STATES;
+            case Event::PresenceUpdate:
+                return GUILD_PRESENCES;
+            case Event::MessageCreate:
+            case Event::MessageUpdate:
+            case Event::MessageDelete:
+                return GUILD_MESSAGES | DIRECT_MESSAGES;
+            case Event::MessageDeleteBulk:
+                return GUILD_MESSAGES;
+            case Event::MessageReactionAdd:
+            case Event::MessageReactionRemove:
+            case Event::MessageReactionRemoveAll:
+            case Event::MessageReactionRemoveEmoji:
+                return GUILD_MESSAGE_REACTIONS | DIRECT_MESSAGE_REACTIONS;
+            case Event::TypingStart:
+                return GUILD_MESSAGE_TYPING | DIRECT_MESSAGE_TYPING;
+            case Event::GuildScheduledEventCreate:
+            case Event::GuildScheduledEventUpdate:
+            case Event::GuildScheduledEventDelete:
+            case Event::GuildScheduledEventUserAdd:
+            case Event::GuildScheduledEventUserRemove:
+                return GUILD_SCHEDULED_EVENTS;
+            case Event::AutoModerationRuleCreate:
+            case Event::AutoModerationRuleUpdate:
+            case Event::AutoModerationRuleDelete:
+                return AUTO_MODERATION_CONFIGURATION;
+            case Event::AutoModerationRuleExecution:
+                return AUTO_MODERATION_EXECUTION;
+            default:
+                // Ready, Resumed, interactions and the like come whatever the intents
+                return 0;
+        }
+    }
+
+    Bot::Event Bot::dispatchEvent(const char* name) {
+        if (!name) return Event::Dispatch;
+        size_t low = 0, high = sizeof(dispatchNames) / sizeof(dispatchNames[0]);
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            int order = strcmp(name, dispatchNames[middle].name);
+            if (order == 0) return dispatchNames[middle].event;
+            if (order < 0) high = middle;
+            else low = middle + 1;
+        }
+        return Event::Dispatch;
+    }
+
+    unsigned int Bot::requiredIntents() const {
+        unsigned int intents = _requiredIntents;
+        // A catch-all onEvent() says nothing about what it wants
+        if (!_subscribedEvents.all()) {
+            for (size_t i = 0; i < _subscribedEvents.size(); ++i) {
+                if (_subscribedEvents[i]) intents |= intentsFor(static_cast<Event>(i));
+            }
+        }
+        return intents;
+    }
+
+    unsigned int Bot::resolveIntents(unsigned int intents) {
+        unsigned int required = requiredIntents();
+        unsigned int resolved = intents == Intents::AUTOMATIC ? required : intents;
+        // Features that asked for intents, like text commands, don't work without them, so they're always added.
+        unsigned int added = _requiredIntents & ~resolved;
+        resolved |= _requiredIntents;
+        if (_intentsResolved && resolved == _intents) return resolved;
+        _intentsResolved = true;
+
+        if (!_subscribedEvents.all()) {
+            for (size_t i = 0; i < _subscribedEvents.size(); ++i) {
+                unsigned int needed = intentsFor(static_cast<Event>(i));
+                if (_subscribedEvents[i] && needed && !(resolved & needed)) {
+                    LOG_W(DISCORD_MESSAGE_PREFIX "%s is subscribed, but intents %u won't deliver it; it needs %u.",
+                        dispatchName(static_cast<Event>(i)), resolved, needed);
+                }
+            }
+        }
+        if (added) {
+            LOG_I(DISCORD_MESSAGE_PREFIX "Added required intents %u to %u.", added, resolved & ~added);
+        }
+        if (!_subscribedEvents.all() && (resolved & ~required)) {
+            LOG_I(DISCORD_MESSAGE_PREFIX "Intents %u deliver events nothing subscribed to.", resolved & ~required);
+        }
+        LOG_I(DISCORD_MESSAGE_PREFIX "Identifying with intents %u.", resolved);
+        return resolved;
     }
 
     void Bot::onInteraction(const InteractionCallback& cb) {
         _interactionCallback = cb;
     }
 
-    inline void Bot::sendCommandResponse(const InteractionResponse& type, const StaticJsonDocument<512>& response) {
+    void Bot::setTextCommands(const char* prefix, const Interactions::ApplicationCommand* commands, size_t length) {
+        _textPrefix = prefix;
+        _textPrefixLength = prefix ? strlen(prefix) : 0;
+        _textCommands.build(commands, length);
+        requireIntents(Intents::DIRECT_MESSAGES);
+    }
 
-#ifdef _DISCORD_CLIENT_DEBUG
-        unsigned long start = millis();
-#endif
+    bool Bot::addAutocomplete(const char* command, const char* option, const CompletionIndex& index) {
+        if (_autocompleteSourcesLength == DISCORD_AUTOCOMPLETE_SOURCES) {
+            LOG_W(DISCORD_MESSAGE_PREFIX "No room to autocomplete %s in %s.", option, command);
+            return false;
+        }
+        _autocompleteSources[_autocompleteSourcesLength++] = { command, option, &index };
+        return true;
+    }
 
-        String url(DISCORD_API_URI "/interactions/");
-        url.reserve(sizeof(uint64_t) + _interactionToken.length() + 11);
-        url += _interactionId;
-        url += "/";
-        url += _interactionToken;
-        url += "/callback";
+    void Bot::captureTo(Print* out) {
+        _lastCaptureAt = millis();
+        _capture = out;
+    }
 
-        String json((char*)0);
-        json.reserve(256);
-        serializeJson(response, json);
+    void Bot::capture(Capture::Kind kind, const char* payload, size_t length) {
+        if (!_capture) return;
+        unsigned long now = millis();
+        Capture::write(*_capture, now - _lastCaptureAt, kind, payload, length);
+        _lastCaptureAt = now;
+    }
 
-        sendPostAsync<256>(_https, "POST", std::move(url), json, _botToken,
-#ifdef _DISCORD_CLIENT_DEBUG
-            [start](const StaticJsonDocument<256>& response) {
-#else
-            [](const StaticJsonDocument<256>& response) {
-#endif
-#ifdef ESP32
-                log_i(DISCORD_MESSAGE_PREFIX "[COMMAND] Response sent.");
-#else
-                Serial.println("[COMMAND] Response sent.");
-#endif
-#ifdef _DISCORD_CLIENT_DEBUG
-                unsigned long end = millis();
-                Serial.print("Time to respond (ms): ");
-                Serial.println(end - start);
-#endif
-            }, &_httpsMtx);
+    bool Bot::startResponder() {
+        if (_responseTask) return true;
+
+        _freeResponseSlots = xQueueCreate(DISCORD_RESPONSE_SLOTS - DISCORD_RESPONSE_RESERVED_SLOTS, sizeof(uint8_t));
+        _reservedResponseSlots = xQueueCreate(DISCORD_RESPONSE_RESERVED_SLOTS, sizeof(uint8_t));
+        _readyResponseSlots = xQueueCreate(DISCORD_RESPONSE_SLOTS, sizeof(uint8_t));
+        if (!_freeResponseSlots || !_reservedResponseSlots || !_readyResponseSlots) {
+            LOG_E(DISCORD_MESSAGE_PREFIX "Failed to create response queues.");
+            return false;
+        }
+        for (uint8_t i = 0; i < DISCORD_RESPONSE_SLOTS; ++i) {
+            xQueueSend(i < DISCORD_RESPONSE_SLOTS - DISCORD_RESPONSE_RESERVED_SLOTS
+                ? _freeResponseSlots : _reservedResponseSlots, &i, 0);
+        }
+
+        // Priority of 2 gets responses out ahead of everything else within the 3s window.
+        if (xTaskCreate(responseTask, "DiscordResponseTask", 6 * 1024, this,
+            tskIDLE_PRIORITY + 2, &_responseTask) != pdPASS) {
+            LOG_E(DISCORD_MESSAGE_PREFIX "Failed to start response task.");
+            _responseTask = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    void Bot::responseTask(void* parameter) {
+        Bot* bot = static_cast<Bot*>(parameter);
+        uint8_t index;
+        // HTTPClient takes Strings, so these are built once rather than converted from the slot on every response.
+        String uri;
+        uri.reserve(DISCORD_RESPONSE_URI_SIZE);
+        const String contentTypeHeader = "Content-Type";
+        const String contentType = "application/json";
+        const String authorizationHeader = "Authorization";
+
+        for (;;) {
+            if (xQueueReceive(bot->_readyResponseSlots, &index, portMAX_DELAY) != pdTRUE) continue;
+            ResponseSlot& slot = bot->_responseSlots[index];
+
+            int httpResponseCode;
+            {
+                ConnectionCache::Lease connection = acquireRest();
+                HTTPClient& https = connection.http();
+                // A path-only URL keeps the connection to DISCORD_HOST open between responses.
+                uri = slot.uri;
+                https.setURL(uri);
+                https.addHeader(contentTypeHeader, contentType);
+                https.addHeader(authorizationHeader, bot->_authorization);
+                TRACE_EVENT(RestSend, index);
+                httpResponseCode = https.sendRequest(slot.method,
+                    reinterpret_cast<uint8_t*>(const_cast<char*>(slot.body)), slot.bodyLength);
+                TRACE_EVENT(RestComplete, httpResponseCode);
+                if (httpResponseCode > 0 && httpResponseCode != HTTP_CODE_NO_CONTENT) {
+                    // Drain the body so the connection can be reused.
+                    https.getString();
+                }
+            }
+
+            if (httpResponseCode == HTTP_CODE_NO_CONTENT || httpResponseCode == HTTP_CODE_OK) {
+                LOG_I(DISCORD_MESSAGE_PREFIX "[COMMAND] Response sent.");
+                LOG_D("Time to respond (ms): %lu", millis() - slot.queuedAt);
+            }
+            else if (httpResponseCode == HTTP_CODE_BAD_REQUEST) {
+                LOG_W(DISCORD_MESSAGE_PREFIX "400 Bad Request.");
+            }
+            else if (httpResponseCode == HTTP_CODE_UNAUTHORIZED) {
+                LOG_W(DISCORD_MESSAGE_PREFIX "401 Not Authorised.");
+            }
+            else {
+                LOG_W(DISCORD_MESSAGE_PREFIX "Error code: %d", httpResponseCode);
+            }
+
+            bot->releaseResponseSlot(index);
+        }
+    }
+
+    bool Bot::commitResponseSlot() {
+        // Taken from the worker, autocomplete and admission on the gateway task, so claimed with a CAS rather
+        // than checked and then incremented.
+        unsigned int committed = _committedResponseSlots.load();
+        do {
+            if (committed >= DISCORD_RESPONSE_SLOTS - DISCORD_RESPONSE_RESERVED_SLOTS) return false;
+        } while (!_committedResponseSlots.compare_exchange_weak(committed, committed + 1));
+        return true;
+    }
+
+    bool Bot::takeResponseSlot(uint8_t& index) {
+        if (!_freeResponseSlots) return false;
+        if (_responseOwed) _responseOwed = false;
+        else if (!commitResponseSlot()) return false;
+        // Every unreserved slot that isn't committed is in the queue, so this only fails if the count is wrong.
+        if (xQueueReceive(_freeResponseSlots, &index, 0) != pdTRUE) {
+            --_committedResponseSlots;
+            return false;
+        }
+        return true;
+    }
+
+    void Bot::releaseResponseSlot(uint8_t index) {
+        if (index >= DISCORD_RESPONSE_SLOTS - DISCORD_RESPONSE_RESERVED_SLOTS) {
+            xQueueSend(_reservedResponseSlots, &index, 0);
+            return;
+        }
+        // Back in the queue before it stops counting, so a slot is always there for whoever commits next.
+        xQueueSend(_freeResponseSlots, &index, 0);
+        --_committedResponseSlots;
+    }
+
+    void Bot::sendCommandResponse(const InteractionResponse& type, const JsonDocument& response) {
+        uint8_t index;
+        if (!takeResponseSlot(index)) {
+            LOG_W(DISCORD_MESSAGE_PREFIX "[COMMAND] No response slot free, response dropped.");
+            return;
+        }
+        ResponseSlot& slot = _responseSlots[index];
 
-        return;
+        slot.method = "POST";
+        slot.body = slot.json;
+        if (_textMessageId) {
+            // A text command is answered with a plain message replying to it, holding the response's data.
+            StaticJsonDocument<DISCORD_MESSAGE_JSON_SIZE> message;
+            message.set(response["data"]);
+            // Ephemeral messages only exist for interactions
+            uint8_t flags = message["flags"] | 0;
+            message.remove("flags");
+            if (flags & static_cast<uint8_t>(MessageResponse::Flags::SUPPRESS_EMBEDS)) {
+                message["flags"] = static_cast<uint8_t>(MessageResponse::Flags::SUPPRESS_EMBEDS);
+            }
+            char messageId[24];
+            snprintf(messageId, sizeof(messageId), "%llu", _textMessageId);
+            JsonObject reference = message.createNestedObject("message_reference");
+            reference["message_id"] = static_cast<const char*>(messageId);
+            reference["fail_if_not_exists"] = false;
+
+            snprintf(slot.uri, sizeof(slot.uri), DISCORD_API_URI "/channels/%llu/messages", _textChannelId);
+            slot.bodyLength = serializeJson(message, slot.json, sizeof(slot.json));
+        }
+        else {
+            snprintf(slot.uri, sizeof(slot.uri), DISCORD_API_URI "/interactions/%llu/%s/callback",
+                _interactionId, _interactionToken);
+            slot.bodyLength = serializeJson(response, slot.json, sizeof(slot.json));
+        }
+        if (slot.bodyLength == 0 || slot.bodyLength >= sizeof(slot.json)) {
+            LOG_W(DISCORD_MESSAGE_PREFIX "[COMMAND] Response too large, dropped.");
+            releaseResponseSlot(index);
+            return;
+        }
+        slot.queuedAt = millis();
+
+        TRACE_EVENT(RestEnqueue, index);
+        xQueueSend(_readyResponseSlots, &index, 0);
+    }
+
+    bool Bot::admit() {
+        if (heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) < DISCORD_ADMISSION_MIN_HEAP) return false;
+        // Promises the interaction a slot for its response. Later responses, like an edit after a deferral,
+        // only get a slot if one is spare.
+        if (!commitResponseSlot()) return false;
+        ++_admittedInteractions;
+        return true;
+    }
+
+    void Bot::retire() {
+        if (_responseOwed) {
+            _responseOwed = false;
+            --_committedResponseSlots;
+        }
+        --_admittedInteractions;
+    }
+
+    void Bot::shed(const JsonObject& interaction) {
+        ++_shedInteractions;
+        uint8_t index;
+        bool taken = _reservedResponseSlots && xQueueReceive(_reservedResponseSlots, &index, 0) == pdTRUE;
+        // Every reserved slot is busy; fall back to a spare unreserved one.
+        if (!taken && _freeResponseSlots && commitResponseSlot()) {
+            taken = xQueueReceive(_freeResponseSlots, &index, 0) == pdTRUE;
+            if (!taken) --_committedResponseSlots;
+        }
+        if (!taken) {
+            LOG_W(DISCORD_MESSAGE_PREFIX "[COMMAND] Overloaded and no response slot free, interaction ignored.");
+            return;
+        }
+        ResponseSlot& slot = _responseSlots[index];
+
+        // The interaction's own id and token; _interactionToken belongs to whichever handler is running.
+        const char* token = interaction["token"];
+        snprintf(slot.uri, sizeof(slot.uri), DISCORD_API_URI "/interactions/%llu/%s/callback",
+            interaction["id"].as<uint64_t>(), token ? token : "");
+        static const char busy[] = DISCORD_BUSY_RESPONSE;
+        slot.method = "POST";
+        slot.body = busy;
+        slot.bodyLength = sizeof(busy) - 1;
+        slot.queuedAt = millis();
+
+        TRACE_EVENT(RestEnqueue, index);
+        xQueueSend(_readyResponseSlots, &index, 0);
+        LOG_W(DISCORD_MESSAGE_PREFIX "[COMMAND] Overloaded, interaction answered as busy.");
     }
 
     void Bot::sendCommandResponse(const InteractionResponse & type, const MessageResponse & response) {
-        if (_interactionId == 0 || _interactionToken.isEmpty()) {
-#ifdef ESP32
-            log_e(DISCORD_MESSAGE_PREFIX "[COMMAND] No token or id available!");
-#else
-            Serial.println(DISCORD_MESSAGE_PREFIX "[COMMAND] No token or id available!");
-#endif
+        if (_textMessageId) {
+            // Nothing to acknowledge: a text command only gets a reply once there is something to say.
+            if (type != InteractionResponse::CHANNEL_MESSAGE_WITH_SOURCE) return;
+        }
+        else if (_interactionId == 0 || _interactionToken[0] == '\0') {
+            LOG_E(DISCORD_MESSAGE_PREFIX "[COMMAND] No token or id available!");
             return;
         }
-        StaticJsonDocument<512> doc;
+        StaticJsonDocument<DISCORD_MESSAGE_JSON_SIZE> doc;
         doc["type"] = static_cast<unsigned short>(type);
-        JsonObject data = doc.createNestedObject("data");
+        // An acknowledgement with no message of its own
+        if (type != InteractionResponse::PONG && type != InteractionResponse::DEFERRED_UPDATE_MESSAGE) {
+            serializeMessage(response, doc.createNestedObject("data"));
+        }
 
-        if (response.tts) data["tts"] = true;
+        sendCommandResponse(type, doc);
+    }
 
-        /*
-        This theory and its following safeguard is currently untested.
+    void Bot::serializeMessage(const MessageResponse& response, JsonObject data) {
+        if (response.tts) data["tts"] = true;
 
-        Buffer safety: If too many simultaneous interactions come in, the ESP32 will have trouble responding to all
-        of the interactions sequentially within their allotted 3-second window due to not having enough heap space to
-        queue and send responses. If that happens, a warning message is appended to the last possible response
-        to notify users the bot is being overloaded, and the bot will fail to respond to subsequent interactions until
-        the existing responses have been sent out.
-        */
-        if (response.content.length() > 0) {
-        data["content"] = response.content; // ArduinoJson sẽ copy từ String
-        } else {
-            data["content"] = ""; // tránh null
-        }
+        // Stored as a pointer, not copied; the serialized copy goes straight into a response slot.
+        data["content"] = response.content ? response.content : "";
 
         if (static_cast<uint8_t>(response.flags)) {
             data["flags"] = static_cast<uint8_t>(response.flags);
         }
 
-        sendCommandResponse(type, doc);
+        if (response.buttons && response.buttonsLength) {
+            JsonObject row = data.createNestedArray("components").createNestedObject();
+            // Action row
+            row["type"] = 1;
+            JsonArray buttons = row.createNestedArray("components");
+            for (size_t i = 0; i < response.buttonsLength && i < DISCORD_MESSAGE_BUTTONS; ++i) {
+                const MessageResponse::Button& button = response.buttons[i];
+                JsonObject component = buttons.createNestedObject();
+                // Button
+                component["type"] = 2;
+                component["style"] = static_cast<uint8_t>(button.style);
+                component["label"] = button.label;
+                component["custom_id"] = button.customId;
+                if (button.disabled) component["disabled"] = true;
+            }
+        }
+    }
+
+    void Bot::editOriginalResponse(const MessageResponse& response) {
+        if (_textMessageId) return;
+        if (_interactionToken[0] == '\0') {
+            LOG_E(DISCORD_MESSAGE_PREFIX "[COMMAND] No token available!");
+            return;
+        }
+        uint8_t index;
+        if (!takeResponseSlot(index)) {
+            LOG_W(DISCORD_MESSAGE_PREFIX "[COMMAND] No response slot free, edit dropped.");
+            return;
+        }
+        ResponseSlot& slot = _responseSlots[index];
+
+        StaticJsonDocument<DISCORD_MESSAGE_JSON_SIZE> doc;
+        serializeMessage(response, doc.to<JsonObject>());
+        // Edits can't change whether a message is ephemeral
+        doc.remove("flags");
+
+        snprintf(slot.uri, sizeof(slot.uri), DISCORD_API_URI "/webhooks/%llu/%s/messages/@original",
+            _applicationId, _interactionToken);
+        slot.method = "PATCH";
+        slot.body = slot.json;
+        slot.bodyLength = serializeJson(doc, slot.json, sizeof(slot.json));
+        if (slot.bodyLength == 0 || slot.bodyLength >= sizeof(slot.json)) {
+            LOG_W(DISCORD_MESSAGE_PREFIX "[COMMAND] Edit too large, dropped.");
+            releaseResponseSlot(index);
+            return;
+        }
+        slot.queuedAt = millis();
+
+        TRACE_EVENT(RestEnqueue, index);
+        xQueueSend(_readyResponseSlots, &index, 0);
     }
 
     void Bot::onWebSocketEvents(WStype_t type, uint8_t * payload, size_t length) {
         switch (type) {
             case WStype_ERROR:
                 if (payload) {
-                    Serial.print(DISCORD_MESSAGE_PREFIX "WebSocket error occured: ");
-                    Serial.println((char*)payload);
+                    LOG_E(DISCORD_MESSAGE_PREFIX "WebSocket error occured: %s", reinterpret_cast<const char*>(payload));
                 }
                 else {
-                    Serial.println(DISCORD_MESSAGE_PREFIX "A WebSocket connection error has occured.");
+                    LOG_E(DISCORD_MESSAGE_PREFIX "A WebSocket connection error has occured.");
                 }
                 break;
             case WStype_DISCONNECTED:
-                Serial.println(DISCORD_MESSAGE_PREFIX "Connection closed.");
+                LOG_I(DISCORD_MESSAGE_PREFIX "Connection closed.");
+                capture(Capture::Kind::Disconnected);
                 _online = false;
+                // Already handled if the bot closed the connection itself
+                if (_state == ConnectionState::DISCONNECTED) break;
+                if (_gatewayFromCache && _heartbeatInterval == 0) {
+                    // Never got as far as HELLO, so the cached URL may be stale.
+                    LOG_I(DISCORD_MESSAGE_PREFIX "Dropping cached gateway URL.");
+                    clearCachedGatewayURL();
+                    _gatewayURL.clear();
+                    _gatewayFromCache = false;
+                }
+                connectionLost("Connection lost.", true);
                 break;
             case WStype_CONNECTED:
-                Serial.println(DISCORD_MESSAGE_PREFIX "Connected to gateway.");
+                LOG_I(DISCORD_MESSAGE_PREFIX "Connected to gateway.");
+                capture(Capture::Kind::Connected);
                 _online = true;
+                _state = ConnectionState::CONNECTING;
+                _attemptStartedAt = _now;
                 break;
             case WStype_TEXT:
-#ifdef _DISCORD_CLIENT_DEBUG
-#ifdef ESP32
-                log_v(DISCORD_MESSAGE_PREFIX "Message received.");
-#else
-                Serial.println(DISCORD_MESSAGE_PREFIX "Message received.");
-#endif
-#endif
+                TRACE_EVENT(FrameReceived, length);
+                LOG_D(DISCORD_MESSAGE_PREFIX "Message received.");
+                capture(Capture::Kind::Received, reinterpret_cast<const char*>(payload), length);
                 parseMessage(payload, length);
                 break;
             case WStype_BIN:
@@ -228,29 +1022,26 @@ namespace Discord {
             case WStype_FRAGMENT_FIN:
                 break;
             case WStype_PING:
-                Serial.println(DISCORD_MESSAGE_PREFIX "Ping received.");
+                LOG_I(DISCORD_MESSAGE_PREFIX "Ping received.");
                 break;
             case WStype_PONG:
-                Serial.println(DISCORD_MESSAGE_PREFIX "Pong received.");
+                LOG_I(DISCORD_MESSAGE_PREFIX "Pong received.");
                 break;
         }
     }
 
     void Bot::parseMessage(uint8_t * payload, size_t length) {
         //Deserialize the first part of our payload
-        DynamicJsonDocument doc(2048);
-        DeserializationError e = deserializeJson(doc, payload, length);
+        // Strings are copied rather than referenced, so the document outlives the socket's buffer
+        // when an interaction is handed over to the worker task.
+        DynamicJsonDocument doc(length + 2048);
+        DeserializationError e = deserializeJson(doc, reinterpret_cast<const char*>(payload), length);
         if (e) {
-            Serial.print("Payload deserializeJson() call failed with code ");
-            Serial.println(e.c_str());
+            LOG_W("Payload deserializeJson() call failed with code %s", e.c_str());
             // Handle the error here, don't pass it upward.
             return;
         }
-
-#ifdef _DISCORD_CLIENT_DEBUG
-        serializeJsonPretty(doc, Serial);
-        Serial.println();
-#endif
+        TRACE_EVENT(ParseDone, doc[_op].as<int>());
 
         switch (static_cast<Event>(doc[_op].as<int>()))
         {
@@ -258,67 +1049,66 @@ namespace Discord {
                 // Dispatch (opcode 0) events are the most common type of event.
                 // Most Gateway events which represent actions taking place in a guild will be sent as Dispatch events.
                 _lastSocketSequence = doc["s"];
+                notify(Event::Dispatch, doc);
 
-                if (_outerCallback != nullptr) {
-                    _outerCallback(Event::Dispatch, doc);
-                }
-
-                if (doc[_t] == "READY") {
-                    _ready = true;
-                    _sessionId = doc[_d]["session_id"].as<const char*>();
-                    _gatewayURL = doc[_d]["resume_gateway_url"].as<const char*>() + 6;
-                    _applicationId = doc[_d]["application"]["id"];
-                    Serial.print(DISCORD_MESSAGE_PREFIX "Gateway URL set to resume on ");
-                    Serial.println(_gatewayURL);
-                    Serial.println(DISCORD_MESSAGE_PREFIX "Ready to comply.");
-                    if (_outerCallback != nullptr) {
-                        _outerCallback(Event::Ready, doc);
-                    }
-                    return;
-                }
-                else if (doc[_t] == "RESUMED") {
-                    Serial.println(DISCORD_MESSAGE_PREFIX "Session resumed.");
-                    if (_outerCallback != nullptr) {
-                        _outerCallback(Event::Resumed, doc);
-                    }
-                    return;
-                }
-                else if (doc[_t] == "INTERACTION_CREATE") {
-                    _interactionToken.reserve(256);
-                    _interactionToken = doc[_d]["token"].as<const char*>();
-                    _interactionId = doc[_d]["id"];
-
-                    const char* interactionName = doc[_d]["data"]["name"];
-                    Serial.print(DISCORD_MESSAGE_PREFIX "[COMMAND] Command ");
-                    Serial.print(doc[_d]["data"]["id"].as<const char*>());
-                    Serial.print(" used: ");
-                    Serial.println(interactionName);
-
-                    if (_interactionCallback != nullptr) {
-                        _interactionCallback(interactionName, doc[_d].as<JsonObject>());
-                    }
-                    else {
-                        Serial.println(DISCORD_MESSAGE_PREFIX "No interaction callback was found, no response given.");
-                    }
-                    return;
-                }
-                // Privileged intent MESSAGE_CONTENT required to see message contents outside of DMs and mentions.
-                else if (doc[_t] == "MESSAGE_CREATE") {
-                    //Ignore our own messages
-                    if (doc[_d]["author"]["id"].as<uint64_t>() == _applicationId) return;
-                    Serial.println(DISCORD_MESSAGE_PREFIX "New chat message received.");
-                    if (_outerCallback != nullptr) {
-                        _outerCallback(Event::MessageCreate, doc);
-                    }
-                    return;
+                switch (dispatchEvent(doc[_t].as<const char*>())) {
+                    case Event::Ready:
+                        xSemaphoreTake(_sessionMtx, portMAX_DELAY);
+                        _sessionId = doc[_d]["session_id"].as<const char*>();
+                        _resumeURL = stripScheme(doc[_d]["resume_gateway_url"].as<const char*>());
+                        xSemaphoreGive(_sessionMtx);
+                        _ready = true;
+                        _applicationId = doc[_d]["application"]["id"];
+                        // A new session starts without a presence
+                        xSemaphoreTake(_presenceMtx, portMAX_DELAY);
+                        _presenceShown = false;
+                        _presencePending = _presenceSet;
+                        xSemaphoreGive(_presenceMtx);
+                        LOG_I(DISCORD_MESSAGE_PREFIX "Gateway URL set to resume on %s", _resumeURL);
+                        LOG_I(DISCORD_MESSAGE_PREFIX "Ready to comply.");
+                        connected(false);
+                        notify(Event::Ready, doc);
+                        return;
+                    case Event::Resumed:
+                        LOG_I(DISCORD_MESSAGE_PREFIX "Session resumed.");
+                        _ready = true;
+                        connected(true);
+                        notify(Event::Resumed, doc);
+                        return;
+                    case Event::InteractionCreate:
+                        if (doc[_d]["type"] == static_cast<uint8_t>(Interaction::Type::APPLICATION_COMMAND_AUTOCOMPLETE)) {
+                            handleAutocomplete(doc[_d].as<JsonObject>());
+                            return;
+                        }
+                        // Turn interactions away now, while there's still time to say so, rather than let them time out.
+                        if (!admit()) {
+                            shed(doc[_d].as<JsonObject>());
+                            return;
+                        }
+                        enqueue(Event::InteractionCreate, doc);
+                        return;
+                    // Privileged intent MESSAGE_CONTENT required to see message contents outside of DMs and mentions.
+                    case Event::MessageCreate:
+                        //Ignore our own messages
+                        if (doc[_d]["author"]["id"].as<uint64_t>() == _applicationId) return;
+                        LOG_I(DISCORD_MESSAGE_PREFIX "New chat message received.");
+                        notify(Event::MessageCreate, doc);
+                        if (!isTextCommand(doc[_d].as<JsonObjectConst>())) return;
+                        // No busy reply here: unlike an interaction, nothing times out if the message goes unanswered.
+                        if (!admit()) {
+                            ++_shedInteractions;
+                            LOG_W(DISCORD_MESSAGE_PREFIX "[COMMAND] Overloaded, text command ignored.");
+                            return;
+                        }
+                        enqueue(Event::MessageCreate, doc);
+                        return;
+                    case Event::Dispatch:
+                        LOG_I(DISCORD_MESSAGE_PREFIX "Unmanaged dispatch event type: %s", doc[_t].as<const char*>());
+                        return;
+                    default:
+                        notify(dispatchEvent(doc[_t].as<const char*>()), doc);
+                        return;
                 }
-                if (_outerCallback != nullptr) {
-                    _outerCallback(static_cast<Event>(doc[_op].as<int>()), doc);
-                    return;
-                }
-                Serial.print(DISCORD_MESSAGE_PREFIX "Unmanaged dispatch event type: ");
-                Serial.println(doc["t"].as<const char*>());
-                return;
             case Event::Heartbeat:
                 heartbeat();
                 break;
@@ -331,145 +1121,466 @@ namespace Discord {
             case Event::Resume:
                 break;
             case Event::Reconnect:
-                logout();
-                login(_intents);
+                connectionLost("Reconnect requested.", true);
                 break;
             case Event::RequestGuildMembers:
                 break;
             case Event::InvalidSession:
-                Serial.println(DISCORD_MESSAGE_PREFIX "Invalid session!");
-                if (doc[_d].as<bool>() == false) {
-                    Serial.println(DISCORD_MESSAGE_PREFIX "Clearing Gateway URL and session id.");
-                    _gatewayURL.clear();
-                    _sessionId.clear();
-                    logout();
-                    login(_intents);
+                // d says whether the session can still be resumed
+                if (doc[_d].as<bool>()) {
+                    connectionLost("Invalid session, resuming.", true);
                 }
                 else {
-                    logout();
+                    connectionLost("Invalid session, identifying.", false);
+                    // Discord asks for a random wait of 1 to 5 seconds before identifying again
+                    unsigned long wait = random(1000, 5000);
+                    if (static_cast<long>(_now + wait - _nextLoginAttempt) > 0) _nextLoginAttempt = _now + wait;
                 }
                 break;
             case Event::Hello:
                 _heartbeatInterval = doc[_d]["heartbeat_interval"];
-                Serial.print(DISCORD_MESSAGE_PREFIX "Heartbeat interval (ms): ");
-                Serial.println(_heartbeatInterval);
+                LOG_I(DISCORD_MESSAGE_PREFIX "Heartbeat interval (ms): %lu", _heartbeatInterval);
 
                 // Jitter is an offset value between 0 and heartbeat_interval that is meant to prevent too many clients 
                 // from reconnecting at the exact same time (which could cause an influx of traffic).
                 _firstHeartbeat = (random(0, 50) / 100.0f) * _heartbeatInterval;
-                Serial.print(DISCORD_MESSAGE_PREFIX "First heartbeat (ms):");
-                Serial.println(_firstHeartbeat);
+                LOG_I(DISCORD_MESSAGE_PREFIX "First heartbeat (ms):%lu", _firstHeartbeat);
 
-                if (_sessionId.isEmpty()) {
+                // The socket may have reconnected by itself, so the session decides rather than login()
+                _resuming = !_sessionId.isEmpty();
+                if (!_resuming) {
+                    _state = ConnectionState::IDENTIFYING;
                     identify();
                 }
                 else {
+                    _state = ConnectionState::RESUMING;
                     resume();
                 }
 
                 _lastHeartbeatSend = _now;
                 _lastHeartbeatAck = _now;
                 _lastRateReset = _now;
+                _unackedHeartbeats = 0;
+                _untrackedAcks = 0;
 
-                if (_outerCallback != nullptr) {
-                    _outerCallback(Event::Hello, doc);
-                }
+                notify(Event::Hello, doc);
                 break;
             case Event::HeartbeatAck:
+                TRACE_EVENT(HeartbeatAck, 0);
                 _lastHeartbeatAck = _now;
-#ifdef _DISCORD_CLIENT_DEBUG 
-#ifdef ESP32
-                log_v(DISCORD_MESSAGE_PREFIX "Heartbeat acknowledged.");
-#else
-                Serial.println(DISCORD_MESSAGE_PREFIX "Heartbeat acknowledged.");
-#endif
-#endif
+                if (_untrackedAcks > 0) {
+                    // Answers a heartbeat dropped to make room, so there's no send time to measure it against.
+                    --_untrackedAcks;
+                    LOG_D(DISCORD_MESSAGE_PREFIX "Heartbeat acknowledged.");
+                }
+                else if (_unackedHeartbeats > 0) {
+                    unsigned long sentAt = _heartbeatsSentAt[0];
+                    unsigned long ackedAt = millis();
+                    --_unackedHeartbeats;
+                    memmove(_heartbeatsSentAt, _heartbeatsSentAt + 1, _unackedHeartbeats * sizeof(_heartbeatsSentAt[0]));
+                    // Read when the socket gets to it, so the ACK may have come sooner; 0 if the keepalive overran it.
+                    unsigned long rtt = static_cast<long>(ackedAt - sentAt) > 0 ? ackedAt - sentAt : 0;
+                    if (!_rttMeasured) {
+                        _srtt = rtt;
+                        _rttvar = rtt / 2;
+                        _rttMeasured = true;
+                    }
+                    else {
+                        unsigned long deviation = rtt > _srtt ? rtt - _srtt : _srtt - rtt;
+                        _rttvar = (3 * _rttvar + deviation) / 4;
+                        _srtt = (7 * _srtt + rtt) / 8;
+                    }
+                    LOG_D(DISCORD_MESSAGE_PREFIX "Heartbeat acknowledged in %lu ms.", rtt);
+                }
+                else {
+                    LOG_D(DISCORD_MESSAGE_PREFIX "Heartbeat acknowledged.");
+                }
                 break;
             default:
                 break;
         }
     }
 
-    void Bot::identify() {
-        String payload;
-        StaticJsonDocument<256> doc;
+    void Bot::handleInteraction(const JsonObject& json) {
+        Interaction interaction(json);
+        strlcpy(_interactionToken, interaction.token(), sizeof(_interactionToken));
+        _interactionId = interaction.id();
+        _responseOwed = true;
 
-        doc[_op] = 2;
+        const char* interactionName = interaction.name();
+        LOG_I(DISCORD_MESSAGE_PREFIX "[COMMAND] Command %s used: %s", json["data"]["id"].as<const char*>(), interactionName);
 
-        JsonObject d = doc.createNestedObject(_d);
-        d["token"] = _botToken;
-        d["intents"] = _intents;
+        runCallback(interactionName, interaction);
+        // Any response the handler sent now holds its own slot.
+        retire();
+    }
 
-        JsonObject d_properties = d.createNestedObject("properties");
-        d_properties["os"] = "esp32";
-        d_properties["browser"] = "esp32";
-        d_properties["device"] = "m5stack";
+    void Bot::handleAutocomplete(const JsonObject& json) {
+        Interaction interaction(json);
+        const char* command = interaction.name();
+        const char* focused = interaction.focusedOption();
 
-        serializeJson(doc, payload);
+        const CompletionIndex* index = nullptr;
+        for (uint8_t i = 0; focused && i < _autocompleteSourcesLength; ++i) {
+            const AutocompleteSource& source = _autocompleteSources[i];
+            if (strcmp(source.command, command) == 0 && strcmp(source.option, focused) == 0) {
+                index = source.index;
+                break;
+            }
+        }
+        // Answered even without an index, so Discord doesn't keep the user waiting on suggestions.
+        const char* choices[DISCORD_AUTOCOMPLETE_CHOICES];
+        size_t count = index ? index->complete(interaction.getString(focused), choices, DISCORD_AUTOCOMPLETE_CHOICES) : 0;
 
-        if (!sendWS(payload.c_str(), payload.length())) return;
+        // Suggestions are only a convenience: never take a slot that commands or busy responses may need.
+        uint8_t slotIndex;
+        if (!_freeResponseSlots || !commitResponseSlot()) {
+            LOG_D(DISCORD_MESSAGE_PREFIX "[AUTOCOMPLETE] No response slot free, suggestions skipped.");
+            return;
+        }
+        if (xQueueReceive(_freeResponseSlots, &slotIndex, 0) != pdTRUE) {
+            --_committedResponseSlots;
+            return;
+        }
+        ResponseSlot& slot = _responseSlots[slotIndex];
+        snprintf(slot.uri, sizeof(slot.uri), DISCORD_API_URI "/interactions/%llu/%s/callback",
+            interaction.id(), interaction.token());
+
+        // The index only holds values that need no escaping, so the body is formatted directly into the slot.
+        size_t length = snprintf(slot.json, sizeof(slot.json), "{\"type\":%u,\"data\":{\"choices\":[",
+            static_cast<unsigned int>(InteractionResponse::APPLICATION_COMMAND_AUTOCOMPLETE_RESULT));
+        static const char tail[] = "]}}";
+        for (size_t i = 0; i < count; ++i) {
+            size_t room = sizeof(slot.json) - length - (sizeof(tail) - 1);
+            int written = snprintf(slot.json + length, room, "%s{\"name\":\"%s\",\"value\":\"%s\"}",
+                i ? "," : "", choices[i], choices[i]);
+            if (written < 0 || static_cast<size_t>(written) >= room) {
+                // Keep the choices that fit
+                slot.json[length] = '\0';
+                break;
+            }
+            length += written;
+        }
+        memcpy(slot.json + length, tail, sizeof(tail));
+        length += sizeof(tail) - 1;
 
-        Serial.print(DISCORD_MESSAGE_PREFIX "Identify event sent. Intents: ");
-        Serial.println(_intents);
+        slot.method = "POST";
+        slot.body = slot.json;
+        slot.bodyLength = length;
+        slot.queuedAt = millis();
+        ++_autocompleteAnswered;
+        TRACE_EVENT(RestEnqueue, slotIndex);
+        xQueueSend(_readyResponseSlots, &slotIndex, 0);
     }
 
-    void Bot::heartbeat() {
-        if (!_socket.isConnected()) {
-            log_e(DISCORD_MESSAGE_PREFIX "Heartbeat not sent. No active connection.");
+    bool Bot::isTextCommand(JsonObjectConst message) const {
+        if (!_textPrefixLength || message["author"]["bot"] | false) return false;
+        const char* content = message["content"] | "";
+        size_t length;
+        return strncmp(content, _textPrefix, _textPrefixLength) == 0
+            && _textCommands.match(content + _textPrefixLength, length);
+    }
+
+    void Bot::handleTextCommand(const JsonObject& message) {
+        _responseOwed = true;
+        const char* text = (message["content"] | "") + _textPrefixLength;
+        size_t nameLength = 0;
+        const Interactions::ApplicationCommand* command = _textCommands.match(text, nameLength);
+        if (!command) {
+            retire();
             return;
         }
-        String payload = "{\"op\":1,\"d\":";
-        if (_lastSocketSequence > 0) {
-            payload += _lastSocketSequence;
-            payload += "}";
+        Arguments arguments(text + nameLength);
+
+        // Dressed up as the slash command, so the same handler and Interaction getters work for both. Strings are
+        // stored as pointers into the message and the arguments, which both outlive the handler.
+        StaticJsonDocument<DISCORD_TEXT_COMMAND_JSON_SIZE> doc;
+        doc["type"] = static_cast<uint8_t>(Interaction::Type::APPLICATION_COMMAND);
+        doc["id"] = message["id"].as<const char*>();
+        doc["channel_id"] = message["channel_id"].as<const char*>();
+        doc["guild_id"] = message["guild_id"].as<const char*>();
+        JsonObjectConst author = message["author"];
+        JsonObject user = doc.createNestedObject("user");
+        user["id"] = author["id"].as<const char*>();
+        user["username"] = author["username"].as<const char*>();
+        JsonObjectConst member = message["member"];
+        if (!member.isNull()) {
+            // Guild messages carry the member without its user
+            JsonObject invoker = doc.createNestedObject("member");
+            invoker["user"] = user;
+            JsonArray roles = invoker.createNestedArray("roles");
+            for (JsonVariantConst role : member["roles"].as<JsonArrayConst>()) {
+                roles.add(role.as<const char*>());
+            }
+        }
+
+        using OptionType = Interactions::ApplicationCommand::OptionType;
+        JsonObject data = doc.createNestedObject("data");
+        data["name"] = command->name;
+        JsonArray options = data.createNestedArray("options");
+        for (size_t i = 0; i < command->optionsLength && i < arguments.size(); ++i) {
+            const Interactions::ApplicationCommand::Option& definition = command->options[i];
+            JsonObject option = options.createNestedObject();
+            option["name"] = definition.name;
+            option["type"] = static_cast<uint8_t>(definition.type);
+            const char* argument = arguments[i];
+            switch (definition.type) {
+                case OptionType::INTEGER:
+                    option["value"] = strtoll(argument, nullptr, 10);
+                    break;
+                case OptionType::NUMBER:
+                    option["value"] = strtod(argument, nullptr);
+                    break;
+                case OptionType::BOOLEAN:
+                    option["value"] = strcasecmp(argument, "true") == 0 || strcasecmp(argument, "yes") == 0
+                        || strcmp(argument, "1") == 0;
+                    break;
+                default:
+                    option["value"] = argument;
+                    break;
+            }
+        }
+        if (doc.overflowed()) {
+            LOG_W(DISCORD_MESSAGE_PREFIX "[COMMAND] Text command too large, ignored.");
+            retire();
+            return;
+        }
+
+        Interaction interaction(doc.as<JsonObjectConst>());
+        _textChannelId = interaction.channelId();
+        _textMessageId = interaction.id();
+        LOG_I(DISCORD_MESSAGE_PREFIX "[COMMAND] Text command used: %s", command->name);
+
+        runCallback(command->name, interaction);
+        _textChannelId = 0;
+        _textMessageId = 0;
+        retire();
+    }
+
+    void Bot::runCallback(const char* name, const Interaction& interaction) {
+        if (_interactionCallback == nullptr) {
+            LOG_I(DISCORD_MESSAGE_PREFIX "No interaction callback was found, no response given.");
+            return;
+        }
+        uint32_t id = static_cast<uint32_t>(interaction.id());
+        unsigned long start = millis();
+        TRACE_EVENT(HandlerStart, id);
+        _interactionCallback(name, interaction);
+        TRACE_EVENT(HandlerEnd, id);
+        // Stamped together once the handler is done, duration first, so a reader who sees the new time also
+        // sees its duration rather than the previous handler's.
+        unsigned long finished = millis();
+        _lastHandlerDuration = finished - start;
+        _lastInteractionAt = finished;
+    }
+
+    void Bot::enqueue(Event type, DynamicJsonDocument& doc) {
+        if (!_interactionTask) {
+            if (type == Event::InteractionCreate) handleInteraction(doc[_d].as<JsonObject>());
+            else handleTextCommand(doc[_d].as<JsonObject>());
+            return;
+        }
+
+        GatewayEvent event { type, _lastSocketSequence, _now, new DynamicJsonDocument(std::move(doc)) };
+        GatewayEvent evicted;
+        switch (_events.push(event, &evicted)) {
+            case PushResult::Rejected:
+                LOG_W(DISCORD_MESSAGE_PREFIX "[COMMAND] Event ring full, interaction dropped.");
+                drop(event);
+                break;
+            case PushResult::Evicted:
+                LOG_W(DISCORD_MESSAGE_PREFIX "[COMMAND] Event ring full, oldest interaction dropped.");
+                drop(evicted);
+                break;
+            default:
+                break;
+        }
+        xTaskNotifyGive(_interactionTask);
+    }
+
+    void Bot::drop(GatewayEvent& event) {
+        // Never ran, so its promised slot was never used.
+        --_committedResponseSlots;
+        --_admittedInteractions;
+        if (event.type == Event::InteractionCreate) {
+            shed((*event.frame)[_d].as<JsonObject>());
         }
         else {
-            payload += "null}";
+            ++_shedInteractions;
         }
+        delete event.frame;
+    }
 
-        if (!sendWS(payload.c_str(), payload.length())) return;
+    void Bot::identify() {
+        size_t length = formatFrame(
+            "{\"op\":2,\"d\":{\"token\":\"%s\",\"intents\":%u,"
+            "\"properties\":{\"os\":\"esp32\",\"browser\":\"esp32\",\"device\":\"m5stack\"}}}",
+            _botToken, _intents);
+
+        if (!sendFrame(length)) return;
+
+        LOG_I(DISCORD_MESSAGE_PREFIX "Identify event sent. Intents: %u", _intents);
+    }
+
+    void Bot::heartbeat() {
+        if (!_socket.isConnected()) {
+            LOG_E(DISCORD_MESSAGE_PREFIX "Heartbeat not sent. No active connection.");
+            return;
+        }
+        size_t length = _lastSocketSequence > 0
+            ? formatFrame("{\"op\":1,\"d\":%u}", _lastSocketSequence)
+            : formatFrame("{\"op\":1,\"d\":null}");
+
+        TRACE_EVENT(HeartbeatSend, _lastSocketSequence);
+        if (!sendFrame(length)) return;
         // Send a periodic request to Discord to preserve the TCP connection.
-        sendRest(_https, "GET", DISCORD_API_URI "/gateway");
+        // Skip it if something else is using the connection, since that keeps it alive anyway.
+        {
+            ConnectionCache::Lease connection = acquireRest(0);
+            if (connection) sendRest(connection.http(), "GET", DISCORD_API_URI "/gateway");
+        }
+
+        // The ACK can't be read until the keepalive is done, so its clock starts from there. millis() rather than
+        // _now, which falls behind by however long this update() has already been busy.
+        if (_unackedHeartbeats == DISCORD_HEARTBEATS_OUTSTANDING) {
+            // More heartbeats than can be tracked, as when Discord asks for extra ones: drop the oldest, whose ACK
+            // then comes first and is skipped, so the rest stay matched to their own.
+            --_unackedHeartbeats;
+            memmove(_heartbeatsSentAt, _heartbeatsSentAt + 1, _unackedHeartbeats * sizeof(_heartbeatsSentAt[0]));
+            ++_untrackedAcks;
+        }
+        _heartbeatsSentAt[_unackedHeartbeats++] = millis();
 
         _lastHeartbeatSend = _now;
 
         if (_lastSocketSequence > 0) {
-            Serial.print(DISCORD_MESSAGE_PREFIX "Heartbeat sent. Sequence: ");
-            Serial.println(_lastSocketSequence);
+            LOG_I(DISCORD_MESSAGE_PREFIX "Heartbeat sent. Sequence: %u", _lastSocketSequence);
         }
         else {
-            Serial.println(F(DISCORD_MESSAGE_PREFIX "Heartbeat sent."));
+            LOG_I(DISCORD_MESSAGE_PREFIX "Heartbeat sent.");
         }
     }
 
     void Bot::resume() {
         if (_sessionId.isEmpty()) {
-            Serial.println(DISCORD_MESSAGE_PREFIX "No session id found! Unable to resume.");
+            LOG_W(DISCORD_MESSAGE_PREFIX "No session id found! Unable to resume.");
         }
-        String payload;
-        StaticJsonDocument<256> doc;
+        size_t length = formatFrame("{\"op\":6,\"d\":{\"token\":\"%s\",\"session_id\":\"%s\",\"seq\":%u}}",
+            _botToken, _sessionId.c_str(), _lastSocketSequence);
 
-        doc[_op] = 6;
+        if (!sendFrame(length)) return;
 
-        JsonObject d = doc.createNestedObject(_d);
-        d["token"] = _botToken;
-        d["session_id"] = _sessionId;
-        d["seq"] = _lastSocketSequence;
+        LOG_I(DISCORD_MESSAGE_PREFIX "Resume event sent. Session: %s, sequence: %u", _sessionId, _lastSocketSequence);
+    }
 
-        serializeJson(doc, payload);
+    size_t Bot::formatFrame(const char* format, ...) {
+        // Tokens, session ids and numbers never need JSON escaping, so plain formatting is enough.
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(_txBuffer + WEBSOCKETS_MAX_HEADER_SIZE, DISCORD_TX_PAYLOAD_SIZE, format, args);
+        va_end(args);
 
-        if (!sendWS(payload.c_str(), payload.length())) return;
+        if (length < 0 || length >= DISCORD_TX_PAYLOAD_SIZE) {
+            LOG_W(DISCORD_MESSAGE_PREFIX "Gateway frame too large for the send buffer.");
+            return 0;
+        }
+        return length;
+    }
 
-        Serial.println(_sessionId);
-        Serial.println(_lastSocketSequence);
-        Serial.println(DISCORD_MESSAGE_PREFIX "Resume event sent.");
+    bool Bot::sendFrame(size_t length) {
+        if (length == 0 || !withinRateLimit()) return false;
+        // Captured first: sending masks the payload in place.
+        capture(Capture::Kind::Sent, _txBuffer + WEBSOCKETS_MAX_HEADER_SIZE, length);
+        // The header goes into the space reserved in front of the payload, and the payload is masked in place,
+        // so the library sends straight from our buffer instead of copying it into a fresh allocation.
+        if (_socket.sendTXT(reinterpret_cast<uint8_t*>(_txBuffer), length, true)) {
+            ++_eventsSent;
+            return true;
+        }
+        return false;
     }
 
-    inline bool Bot::sendWS(const char* payload, size_t length) {
-        if (_rateLimit && _eventsSent >= 120) {
-            Serial.println(DISCORD_MESSAGE_PREFIX "Rate limit reached! Maximum of 120 WebSocket events/min.");
+    inline bool Bot::withinRateLimit() {
+        if (_rateLimit && _eventsSent >= DISCORD_GATEWAY_RATE_LIMIT) {
+            LOG_W(DISCORD_MESSAGE_PREFIX "Rate limit reached! Maximum of 120 WebSocket events/min.");
             return false;
         }
+        return true;
+    }
+
+    void Bot::setPresence(Status status, ActivityType type, const char* activity) {
+        Presence presence;
+        presence.status = status;
+        presence.type = type;
+        // Escaped here, so updatePresence() can format the frame without a JSON document
+        size_t length = 0;
+        for (const char* c = activity ? activity : ""; *c && length + 2 < sizeof(presence.activity); ++c) {
+            if (static_cast<unsigned char>(*c) < 0x20) continue;
+            if (*c == '"' || *c == '\\') presence.activity[length++] = '\\';
+            presence.activity[length++] = *c;
+        }
+        presence.activity[length] = '\0';
+
+        xSemaphoreTake(_presenceMtx, portMAX_DELAY);
+        if (!(presence == _pendingPresence) || !_presenceSet) {
+            if (_presencePending) ++_presenceCoalesced;
+            _pendingPresence = presence;
+            _presencePending = !_presenceShown || !(presence == _sentPresence);
+            _presenceChangedAt = millis();
+            _presenceSet = true;
+        }
+        xSemaphoreGive(_presenceMtx);
+    }
+
+    void Bot::updatePresence() {
+        if (!_presencePending || !_ready || !_socket.isConnected()) return;
+        if (_now - _lastPresenceSent < DISCORD_PRESENCE_INTERVAL && _lastPresenceSent != 0) return;
+        if (_presenceSentThisMinute >= DISCORD_PRESENCE_BUDGET) return;
+
+        xSemaphoreTake(_presenceMtx, portMAX_DELAY);
+        if (millis() - _presenceChangedAt < DISCORD_PRESENCE_DEBOUNCE) {
+            xSemaphoreGive(_presenceMtx);
+            return;
+        }
+        Presence presence = _pendingPresence;
+        _presencePending = false;
+        xSemaphoreGive(_presenceMtx);
+
+        static const char* const statuses[] = { "online", "idle", "dnd", "invisible" };
+        const char* status = statuses[static_cast<int>(presence.status)];
+        size_t length;
+        if (presence.type == ActivityType::NONE) {
+            length = formatFrame("{\"op\":3,\"d\":{\"since\":null,\"activities\":[],\"status\":\"%s\",\"afk\":false}}",
+                status);
+        }
+        else if (presence.type == ActivityType::CUSTOM) {
+            length = formatFrame("{\"op\":3,\"d\":{\"since\":null,\"activities\":[{\"name\":\"Custom Status\",\"type\":4,"
+                "\"state\":\"%s\"}],\"status\":\"%s\",\"afk\":false}}", presence.activity, status);
+        }
+        else {
+            length = formatFrame("{\"op\":3,\"d\":{\"since\":null,\"activities\":[{\"name\":\"%s\",\"type\":%d}],"
+                "\"status\":\"%s\",\"afk\":false}}", presence.activity, static_cast<int>(presence.type), status);
+        }
+
+        if (!sendFrame(length)) {
+            // Try again on a later update
+            xSemaphoreTake(_presenceMtx, portMAX_DELAY);
+            _presencePending = true;
+            xSemaphoreGive(_presenceMtx);
+            return;
+        }
+        xSemaphoreTake(_presenceMtx, portMAX_DELAY);
+        _sentPresence = presence;
+        _presenceShown = true;
+        xSemaphoreGive(_presenceMtx);
+        _lastPresenceSent = _now;
+        ++_presenceSentThisMinute;
+        LOG_I(DISCORD_MESSAGE_PREFIX "Presence updated: %s %s", status, presence.activity);
+    }
+
+    bool Bot::sendWS(const char* payload, size_t length) {
+        if (!withinRateLimit()) return false;
+        capture(Capture::Kind::Sent, payload, length);
         if (_socket.sendTXT(payload, length)) {
             ++_eventsSent;
             return true;
@@ -497,44 +1608,22 @@ namespace Discord {
         else {
             httpResponseCode = client.sendRequest(method);
         }
-#ifdef _DISCORD_CLIENT_DEBUG
-#ifdef ESP32
-        log_d("[DISCORD] Sent %s request to %s", method, uri.c_str());
-#else
-        Serial.print(method);
-        Serial.print(" request to ");
-        Serial.println(uri);
-#endif
-#endif
+        LOG_D(DISCORD_MESSAGE_PREFIX "Sent %s request to %s", method, uri);
 
         if (httpResponseCode > 0) {
-#ifdef _DISCORD_CLIENT_DEBUG
-#ifdef ESP32
-            log_d("[DISCORD] HTTP Response code: %d", httpResponseCode);
-#else
-            Serial.print("[DISCORD] HTTP Response code: ");
-            Serial.println(httpResponseCode);
-#endif
-#endif
+            LOG_D(DISCORD_MESSAGE_PREFIX "HTTP Response code: %d", httpResponseCode);
             if (httpResponseCode != 204) { //204 no content
-#ifdef _DISCORD_CLIENT_DEBUG
-#ifdef ESP32
-                log_d("%s", client.getString().c_str());
-#else
-                Serial.println(client.getString());
-#endif
-#endif
+                LOG_D("%s", client.getString());
             }
             if (httpResponseCode == 401) {
-                Serial.println("[DISCORD] 401 Not Authorised.");
+                LOG_W(DISCORD_MESSAGE_PREFIX "401 Not Authorised.");
                 return false;
             }
             return true;
         }
 
         // Request failed
-        Serial.print("[DISCORD] Error code: ");
-        Serial.println(httpResponseCode);
+        LOG_W(DISCORD_MESSAGE_PREFIX "Error code: %d", httpResponseCode);
         return false;
     }
 }
\ No newline at end of file
@@ -0,0 +1,126 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <health.h>
+#include <log.h>
+#include <WiFi.h>
+#include <esp_heap_caps.h>
+#include <atomic>
+
+#define HEALTH_MESSAGE_PREFIX "[HEALTH] "
+
+namespace Health {
+    namespace {
+        std::atomic<uint32_t> allocationFailures { 0 };
+
+        void onAllocationFailed(size_t size, uint32_t caps, const char* functionName) {
+            // Runs inside the failing allocator, so only count here.
+            ++allocationFailures;
+        }
+    }
+
+    Supervisor::Supervisor(Discord::Bot& bot, const Thresholds& thresholds) :
+        _bot { bot }, _thresholds { thresholds } {}
+
+    void Supervisor::begin() {
+        heap_caps_register_failed_alloc_callback(onAllocationFailed);
+        _windowStart = millis();
+    }
+
+    const char* Supervisor::check(unsigned long now) {
+        _largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+        if (_largestFreeBlock < _minLargestFreeBlock) _minLargestFreeBlock = _largestFreeBlock;
+        if (_largestFreeBlock < _thresholds.minLargestFreeBlock) {
+            if (++_fragmentedCount >= _thresholds.fragmentedChecks) return "heap fragmented";
+        }
+        else {
+            _fragmentedCount = 0;
+        }
+
+        if (now - _windowStart > _thresholds.allocationFailureWindow) {
+            _windowStart = now;
+            _windowFailures = allocationFailures.exchange(0);
+        }
+        else {
+            _windowFailures += allocationFailures.exchange(0);
+        }
+        if (_windowFailures > _thresholds.maxAllocationFailures) return "allocations failing";
+
+        if (_bot.online() || !WiFi.isConnected()) {
+            _offlineSince = 0;
+        }
+        else if (_offlineSince == 0) {
+            _offlineSince = now;
+        }
+        else if (now - _offlineSince > _thresholds.maxOfflineTime) {
+            return "gateway unreachable";
+        }
+
+        unsigned long interval = _bot.heartbeatInterval();
+        if (_bot.online() && interval > 0 && _bot.lastHeartbeatAck() > 0
+            && now - _bot.lastHeartbeatAck() > interval * _thresholds.missedHeartbeats) {
+            return "heartbeats unacknowledged";
+        }
+
+        unsigned long lastInteraction = _bot.lastInteractionAt();
+        if (lastInteraction != _lastSeenInteraction) {
+            _lastSeenInteraction = lastInteraction;
+            // Weight of 1/4 on the newest sample, so one slow command can't trigger a restart on its own.
+            _handlerLatency = (_handlerLatency * 3 + _bot.lastHandlerDuration()) / 4;
+            if (_handlerLatency > _thresholds.maxHandlerLatency) return "handlers too slow";
+        }
+
+        return nullptr;
+    }
+
+    bool Supervisor::update(unsigned long now, bool busy) {
+        if (now - _lastCheck < _thresholds.checkInterval) return false;
+        _lastCheck = now;
+
+        if (!_reason) {
+            _reason = check(now);
+            if (!_reason) return false;
+
+            _drainStart = now;
+            LOG_W(HEALTH_MESSAGE_PREFIX "Restart needed: %s. Waiting for a quiet moment.", _reason);
+            report();
+        }
+
+        // A handler still running hasn't stamped lastInteractionAt() yet, so it is counted separately.
+        bool quiet = !busy
+            && _bot.inFlightResponses() == 0
+            && _bot.pendingEvents() == 0
+            && _bot.activeInteractions() == 0
+            && now - _bot.lastInteractionAt() > _thresholds.quietPeriod;
+        if (quiet) return true;
+
+        if (now - _drainStart > _thresholds.maxDrainTime) {
+            LOG_W(HEALTH_MESSAGE_PREFIX "Never went quiet, restarting anyway.");
+            return true;
+        }
+        return false;
+    }
+
+    void Supervisor::report() const {
+        LOG_I(HEALTH_MESSAGE_PREFIX "Largest free block: %u bytes (lowest %u), free heap: %u bytes",
+            _largestFreeBlock, _minLargestFreeBlock, heap_caps_get_free_size(MALLOC_CAP_8BIT));
+        LOG_I(HEALTH_MESSAGE_PREFIX "Failed allocations this window: %u", static_cast<unsigned>(_windowFailures));
+        LOG_I(HEALTH_MESSAGE_PREFIX "Handler latency: %lu ms, responses in flight: %u, events pending: %u",
+            _handlerLatency, _bot.inFlightResponses(), _bot.pendingEvents());
+    }
+}
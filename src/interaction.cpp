@@ -0,0 +1,98 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <interaction.h>
+#include <interactions.h>
+
+namespace Discord {
+    using OptionType = Interactions::ApplicationCommand::OptionType;
+
+    const char* Interaction::name() const {
+        JsonObjectConst d = data();
+        const char* name = d["name"];
+        if (name) return name;
+        return d["custom_id"] | "";
+    }
+
+    JsonObjectConst Interaction::user() const {
+        if (!(_cached & Cached::User)) {
+            // Guild interactions carry member.user; DMs carry user
+            JsonObjectConst member = _json["member"].as<JsonObjectConst>();
+            _user = member.isNull() ? _json["user"].as<JsonObjectConst>() : member["user"].as<JsonObjectConst>();
+            _userId = _user["id"].as<uint64_t>();
+            _cached |= Cached::User;
+        }
+        return _user;
+    }
+
+    uint64_t Interaction::userId() const {
+        user();
+        return _userId;
+    }
+
+    const char* Interaction::username() const {
+        return user()["username"] | "";
+    }
+
+    const char* Interaction::focusedOption() const {
+        cacheOptions();
+        for (uint8_t i = 0; i < _optionsLength; ++i) {
+            if (_options[i].focused) return _options[i].name;
+        }
+        return nullptr;
+    }
+
+    JsonVariantConst Interaction::option(const char* name) const {
+        cacheOptions();
+        for (uint8_t i = 0; i < _optionsLength; ++i) {
+            if (strcmp(_options[i].name, name) == 0) return _options[i].value;
+        }
+        return JsonVariantConst();
+    }
+
+    void Interaction::cacheOptions() const {
+        if (_cached & Cached::Options) return;
+        _cached |= Cached::Options;
+
+        JsonArrayConst options = data()["options"].as<JsonArrayConst>();
+        // Values sit under at most a group and a subcommand, each of which is a single option holding the rest
+        for (uint8_t depth = 0; depth < 2 && options.size() == 1; ++depth) {
+            JsonObjectConst nested = options[0].as<JsonObjectConst>();
+            OptionType type = static_cast<OptionType>(nested["type"].as<uint8_t>());
+            if (type == OptionType::SUB_COMMAND_GROUP) {
+                _subcommandGroup = nested["name"];
+            }
+            else if (type == OptionType::SUB_COMMAND) {
+                _subcommand = nested["name"];
+            }
+            else {
+                break;
+            }
+            options = nested["options"].as<JsonArrayConst>();
+        }
+
+        for (JsonVariantConst option : options) {
+            if (_optionsLength == DISCORD_INTERACTION_OPTIONS) break;
+            const char* name = option["name"];
+            if (!name) continue;
+            _options[_optionsLength++] = { name, option["value"], option["focused"] | false };
+        }
+    }
+}
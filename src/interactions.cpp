@@ -18,6 +18,8 @@
 
 #include <interactions.h>
 #include "discord.h"
+#include <connectioncache.h>
+#include <log.h>
 #ifdef _DISCORD_CLIENT_DEBUG
 #include <StreamUtils.h>
 #endif
@@ -30,26 +32,22 @@ namespace Discord::Interactions {
 
         if (!serializeCommand(command, doc)) return 0;
 
-        String url(DISCORD_HOST DISCORD_API_URI "/applications/");
+        String url(DISCORD_API_URI "/applications/");
         url += applicationId;
         url += "/commands";
 
         String json((char*)0);
         json.reserve(1024);
         serializeJson(doc, json);
-        HTTPClient _http;
-        _http.begin(url, nullptr);
+        ConnectionCache::Lease connection =
+            connectionCache.acquire(DISCORD_API_HOSTNAME, DISCORD_API_PORT, DISCORD_API_SECURE);
         StaticJsonDocument<512> response;
-        if (sendRest<512>(_http, "POST", url, json, botToken, &response)) {
+        if (sendRest<512>(connection.http(), "POST", url, json, botToken, &response)) {
             uint64_t idString = response["id"];
 
-            Serial.print(DISCORD_INTERACTION_LOG_PREFIX "Global command ");
-            Serial.print(idString);
-            Serial.println(" registered.");
-            _http.end();
+            LOG_I(DISCORD_INTERACTION_LOG_PREFIX "Global command %llu registered.", idString);
             return idString;
         }
-        _http.end();
         return 0;
     }
 
@@ -58,7 +56,7 @@ namespace Discord::Interactions {
 
         if (!serializeCommand(command, doc)) return 0;
 
-        String url(DISCORD_HOST DISCORD_API_URI "/applications/");
+        String url(DISCORD_API_URI "/applications/");
         url += applicationId;
         url += "/guilds/";
         url += guildId;
@@ -67,54 +65,46 @@ namespace Discord::Interactions {
         String json((char*)0);
         json.reserve(1024);
         serializeJson(doc, json);
-        HTTPClient _http;
-        _http.begin(url, nullptr);
+        ConnectionCache::Lease connection =
+            connectionCache.acquire(DISCORD_API_HOSTNAME, DISCORD_API_PORT, DISCORD_API_SECURE);
         StaticJsonDocument<512> response;
-        if (sendRest<512>(_http, "POST", url, json, botToken, &response)) {
+        if (sendRest<512>(connection.http(), "POST", url, json, botToken, &response)) {
             uint64_t idString = response["id"];
 
-            Serial.print(DISCORD_INTERACTION_LOG_PREFIX "[COMMAND] Guild command ");
-            Serial.print(idString);
-            Serial.println(" registered.");
-            _http.end();
+            LOG_I(DISCORD_INTERACTION_LOG_PREFIX "Guild command %llu registered.", idString);
             return idString;
         }
-        _http.end();
         return 0;
     }
 
     bool deleteGlobalCommand(uint64_t applicationId, const String& commandId, const char* botToken) {
-        HTTPClient _http;
-        String url(DISCORD_HOST DISCORD_API_URI "/applications/");
+        String url(DISCORD_API_URI "/applications/");
         url += applicationId;
         url += "/commands/";
         url += commandId;
-        _http.begin(url);
+        ConnectionCache::Lease connection =
+            connectionCache.acquire(DISCORD_API_HOSTNAME, DISCORD_API_PORT, DISCORD_API_SECURE);
 
-        bool result = sendRest(_http, "DELETE", url, "", botToken);
-        _http.end();
-        return result;
+        return sendRest(connection.http(), "DELETE", url, "", botToken);
     }
 
     bool deleteGuildCommand(
         uint64_t applicationId, const char* guildId, const String& commandId, const char* botToken) {
-        HTTPClient _http;
-        String url(DISCORD_HOST DISCORD_API_URI "/applications/");
+        String url(DISCORD_API_URI "/applications/");
         url += applicationId;
         url += "/guilds/";
         url += guildId;
         url += "/commands/";
         url += commandId;
-        _http.begin(url);
+        ConnectionCache::Lease connection =
+            connectionCache.acquire(DISCORD_API_HOSTNAME, DISCORD_API_PORT, DISCORD_API_SECURE);
 
-        bool result = sendRest(_http, "DELETE", url, "", botToken);
-        _http.end();
-        return result;
+        return sendRest(connection.http(), "DELETE", url, "", botToken);
     }
 
     bool serializeCommand(const ApplicationCommand& command, StaticJsonDocument<1024>& doc) {
         if (!strlen(command.name) || strlen(command.name) > 32) {
-            Serial.println(DISCORD_INTERACTION_LOG_PREFIX "Invalid name provided!");
+            LOG_W(DISCORD_INTERACTION_LOG_PREFIX "Invalid name provided!");
             return false;
         }
         doc["name"] = command.name;
@@ -128,7 +118,7 @@ namespace Discord::Interactions {
                 JsonObject option_obj = options.createNestedObject();
                 ApplicationCommand::Option& option = command.options[i];
                 if (!strlen(option.name) || strlen(option.name) > 32) {
-                    Serial.println(DISCORD_INTERACTION_LOG_PREFIX "Invalid option name provided!");
+                    LOG_W(DISCORD_INTERACTION_LOG_PREFIX "Invalid option name provided!");
                     return false;
                 }
 
@@ -136,6 +126,9 @@ namespace Discord::Interactions {
                 option_obj["description"] = option.description;
                 option_obj["type"] = static_cast<int>(option.type);
                 option_obj["required"] = option.required;
+                if (option.autocomplete && option.choicesLength == 0) {
+                    option_obj["autocomplete"] = true;
+                }
 
                 if (option.choicesLength > 0) {
                     JsonArray choice_array = option_obj.createNestedArray("choices");
@@ -144,7 +137,7 @@ namespace Discord::Interactions {
                         JsonObject choice_obj = choice_array.createNestedObject();
                         ApplicationCommand::Option::Choice& choice = option.choices[i];
                         if (!strlen(choice.name) || strlen(choice.name) > 32) {
-                            Serial.println(DISCORD_INTERACTION_LOG_PREFIX "Invalid option choice name provided!");
+                            LOG_W(DISCORD_INTERACTION_LOG_PREFIX "Invalid option choice name provided!");
                             return false;
                         }
 
@@ -161,7 +154,7 @@ namespace Discord::Interactions {
                                 choice_obj["value"] = choice.doubleValue;
                                 break;
                             default:
-                                Serial.println(DISCORD_INTERACTION_LOG_PREFIX "Invalid option type provided with choice!");
+                                LOG_W(DISCORD_INTERACTION_LOG_PREFIX "Invalid option type provided with choice!");
                                 break;
                         }
                     }
@@ -0,0 +1,235 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <log.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <algorithm>
+
+#define LOGGER_MESSAGE_PREFIX "[LOG] "
+// How often the drain task looks for new messages
+#define LOGGER_DRAIN_INTERVAL 20
+
+namespace Log {
+    namespace {
+        constexpr uint32_t mask = LOGGER_RECORDS - 1;
+
+        // Zero-initialised, which is already the empty state, so logging works even from static constructors.
+        Detail::Record records[LOGGER_RECORDS];
+        std::atomic<uint32_t> enqueuePosition { 0 };
+        std::atomic<uint32_t> droppedRecords { 0 };
+
+        // Consumer side, guarded by drainMtx so flush() and the drain task can't both pop
+        uint32_t dequeuePosition = 0;
+        uint32_t reportedDropped = 0;
+        SemaphoreHandle_t drainMtx = nullptr;
+        Print* output = nullptr;
+
+        // A slot's state is base(position) while free for that position, base + 1 once written, and advances by
+        // LOGGER_RECORDS when read, freeing it for the next lap. Wraps around cleanly with the positions.
+        uint32_t base(uint32_t position) {
+            return position & ~mask;
+        }
+
+        bool isIntegerConversion(char conversion) {
+            return strchr("diouxXc", conversion) != nullptr;
+        }
+
+        bool isFloatConversion(char conversion) {
+            return strchr("fFeEgGaA", conversion) != nullptr;
+        }
+
+        // Expands record's format with its arguments. Each conversion is formatted as the type that was actually
+        // stored, so a mismatched specifier prints the wrong style rather than reading the wrong bytes.
+        size_t format(const Detail::Record& record, char* out, size_t size) {
+            const char* f = record.format;
+            const uint8_t* arg = record.args;
+            const uint8_t* end = record.args + record.length;
+            size_t n = 0;
+
+            while (*f && n + 1 < size) {
+                if (*f != '%') {
+                    out[n++] = *f++;
+                    continue;
+                }
+                if (f[1] == '%') {
+                    out[n++] = '%';
+                    f += 2;
+                    continue;
+                }
+
+                // Flags, width and precision are kept; length modifiers are replaced by the stored type's.
+                char spec[16];
+                size_t s = 0;
+                spec[s++] = *f++;
+                while (*f && strchr("-+ #0123456789.", *f) && s < sizeof(spec) - 4) spec[s++] = *f++;
+                while (*f && strchr("hlLqjzt", *f)) ++f;
+                if (!*f) break;
+                char conversion = *f++;
+
+                char tag = arg < end ? static_cast<char>(*arg++) : '\0';
+                int written = 0;
+                if (tag == 'i' || tag == 'u') {
+                    uint64_t value;
+                    memcpy(&value, arg, sizeof(value));
+                    arg += sizeof(value);
+                    if (conversion == 'c') {
+                        spec[s++] = 'c';
+                        spec[s] = '\0';
+                        written = snprintf(out + n, size - n, spec, static_cast<int>(value));
+                    }
+                    else {
+                        spec[s++] = 'l';
+                        spec[s++] = 'l';
+                        spec[s++] = isIntegerConversion(conversion) ? conversion : (tag == 'i' ? 'd' : 'u');
+                        spec[s] = '\0';
+                        if (tag == 'i') {
+                            written = snprintf(out + n, size - n, spec, static_cast<long long>(value));
+                        }
+                        else {
+                            written = snprintf(out + n, size - n, spec, static_cast<unsigned long long>(value));
+                        }
+                    }
+                }
+                else if (tag == 'f') {
+                    double value;
+                    memcpy(&value, arg, sizeof(value));
+                    arg += sizeof(value);
+                    spec[s++] = isFloatConversion(conversion) ? conversion : 'g';
+                    spec[s] = '\0';
+                    written = snprintf(out + n, size - n, spec, value);
+                }
+                else if (tag == 's') {
+                    const char* value = reinterpret_cast<const char*>(arg);
+                    arg += strlen(value) + 1;
+                    spec[s++] = 's';
+                    spec[s] = '\0';
+                    written = snprintf(out + n, size - n, spec, value);
+                }
+                else {
+                    // Ran out of arguments, or they were cut off by LOGGER_ARGS_SIZE
+                    written = snprintf(out + n, size - n, "?");
+                }
+                if (written > 0) n += std::min(static_cast<size_t>(written), size - 1 - n);
+            }
+            out[n] = '\0';
+            return n;
+        }
+
+        // Writes out whatever has been published. Messages claimed but not yet published stop the drain until
+        // the next pass, so lines always come out in the order they were claimed.
+        void drain(Print& out) {
+            char line[LOGGER_LINE_SIZE];
+            for (;;) {
+                Detail::Record& record = records[dequeuePosition & mask];
+                if (record.state.load(std::memory_order_acquire) != base(dequeuePosition) + 1) break;
+
+                size_t length = format(record, line, sizeof(line));
+                record.state.store(base(dequeuePosition) + LOGGER_RECORDS, std::memory_order_release);
+                ++dequeuePosition;
+
+                out.write(reinterpret_cast<const uint8_t*>(line), length);
+                out.write(reinterpret_cast<const uint8_t*>("\r\n"), 2);
+            }
+
+            uint32_t dropped = droppedRecords.load(std::memory_order_relaxed);
+            if (dropped != reportedDropped) {
+                int length = snprintf(line, sizeof(line), LOGGER_MESSAGE_PREFIX "%u message(s) dropped, log ring full.\r\n",
+                    static_cast<unsigned int>(dropped - reportedDropped));
+                out.write(reinterpret_cast<const uint8_t*>(line), length);
+                reportedDropped = dropped;
+            }
+        }
+
+        void drainTask(void* parameter) {
+            for (;;) {
+                xSemaphoreTake(drainMtx, portMAX_DELAY);
+                drain(*output);
+                xSemaphoreGive(drainMtx);
+                vTaskDelay(pdMS_TO_TICKS(LOGGER_DRAIN_INTERVAL));
+            }
+        }
+    }
+
+    bool begin(Print& out, UBaseType_t priority) {
+        if (drainMtx) return true;
+        output = &out;
+        drainMtx = xSemaphoreCreateMutex();
+        if (!drainMtx) return false;
+        return xTaskCreate(drainTask, "LogTask", 3 * 1024, nullptr, priority, nullptr) == pdPASS;
+    }
+
+    void flush() {
+        if (!drainMtx) return;
+        xSemaphoreTake(drainMtx, portMAX_DELAY);
+        drain(*output);
+        xSemaphoreGive(drainMtx);
+    }
+
+    uint32_t dropped() {
+        return droppedRecords.load(std::memory_order_relaxed);
+    }
+
+    namespace Detail {
+        Record* claim() {
+            uint32_t position = enqueuePosition.load(std::memory_order_relaxed);
+            for (;;) {
+                Record& record = records[position & mask];
+                uint32_t state = record.state.load(std::memory_order_acquire);
+                int32_t difference = static_cast<int32_t>(state - base(position));
+                if (difference == 0) {
+                    if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        record.position = position;
+                        return &record;
+                    }
+                }
+                else if (difference < 0) {
+                    // Still holds a message from the previous lap
+                    droppedRecords.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                else {
+                    // Another task claimed this position first
+                    position = enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void publish(Record& record) {
+            record.state.store(base(record.position) + 1, std::memory_order_release);
+        }
+
+        void Encoder::put(const char* value) {
+            if (!value) value = "(null)";
+            size_t available = sizeof(_record.args) - _record.length;
+            if (available < 2) return;
+            size_t length = std::min(strlen(value), available - 2);
+            _record.args[_record.length++] = 's';
+            memcpy(_record.args + _record.length, value, length);
+            _record.length += length;
+            _record.args[_record.length++] = '\0';
+        }
+
+        void Encoder::raw(char tag, const void* value, size_t size) {
+            if (sizeof(_record.args) - _record.length < size + 1) return;
+            _record.args[_record.length++] = tag;
+            memcpy(_record.args + _record.length, value, size);
+            _record.length += size;
+        }
+    }
+}
@@ -26,23 +26,59 @@
 #include <ESP32Ping.h> 
 #include <UniversalTelegramBot.h> 
 
+#include <authorization.h>
+#include <boot.h>
+#include <connectioncache.h>
 #include <discord.h>
+#include <health.h>
+#include <log.h>
+#include <trace.h>
 #include <interactions.h>
 #include <privateconfig.h>
 
-#define LOGIN_INTERVAL 30000 //Cannot be too short to give time to initially retrieve the gateway API
-
 WiFiMulti wifiMulti;
 WiFiUDP UDP;
 WakeOnLan WOL(UDP);
 
+// ===== ACCESS CONFIG =====
+// Commands without a rule are open to everyone.
+const Authorization::Rule accessRules[] = {
+    { "wake", Authorization::Users | Authorization::Roles | Authorization::TelegramChats },
+    { "trace", Authorization::Users | Authorization::Roles },
+};
+Authorization::Engine access;
+
 // ===== DISCORD CONFIG =====
 Discord::Bot discord(botToken, applicationId);
 
+// Hosts /wake and /pcstatus know by name; the first is the default.
+struct Host {
+    const char* name;
+    const char* ip;
+    // Empty if it can't be woken
+    const char* mac;
+};
+const Host hosts[] = {
+    { "pc", PCTargetIP, macAddress },
+    { "ps", PSTargetIP, "" },
+};
+const char* const hostNames[] = { "pc", "ps" };
+// Suggested as the host option is typed
+Discord::CompletionIndex hostIndex;
+
+const Host* findHost(const char* name) {
+    for (const Host& host : hosts) {
+        if (strcasecmp(host.name, name) == 0) return &host;
+    }
+    return nullptr;
+}
+
 bool botEnabled = true;
 bool broadcastAddrSet = false;
 bool commandsRegistered = false;
-unsigned long lastLoginAttempt = 0;
+// Global commands persist on Discord's side, so there is no need to register them again after a planned restart.
+#define COMMANDS_REGISTERED_MAGIC 0x434D4453UL
+RTC_NOINIT_ATTR uint32_t commandsRegisteredMagic;
 
 // ===== TELEGRAM CONFIG =====
 WiFiClientSecure secured_client;
@@ -51,8 +87,79 @@ bool telegramEnabled = false;
 unsigned long lastTelegramMessageTime = 0;
 const unsigned long TELEGRAM_TIMEOUT = 60000;
 
-unsigned long lastCheckTime = 0;
-const unsigned long botPollingInterval = 2000;
+// Long polling keeps its request open for up to TELEGRAM_LONG_POLL seconds, so it gets its own client
+// and runs in its own task. Replies still go out through telegramBot/secured_client.
+WiFiClientSecure telegram_poll_client;
+UniversalTelegramBot telegramPoller(telegramToken, telegram_poll_client);
+const int TELEGRAM_LONG_POLL = 20; // seconds
+const UBaseType_t TELEGRAM_INBOX_LENGTH = 8;
+
+struct TelegramMessage {
+    char chatId[24];
+    char text[64];
+};
+
+QueueHandle_t telegramInbox = nullptr;
+
+// Replies are queued and sent by a background task that owns telegramBot/secured_client,
+// keeping the TLS connection alive between sends and merging replies bound for the same chat.
+const UBaseType_t TELEGRAM_OUTBOX_LENGTH = 8;
+
+struct TelegramReply {
+    char chatId[24];
+    char text[128];
+    unsigned long queuedAt;
+};
+
+QueueHandle_t telegramOutbox = nullptr;
+volatile bool telegramSending = false;
+unsigned long telegramMessagesSent = 0;
+unsigned long telegramSendFailures = 0;
+
+// ===== BOOT SEQUENCE =====
+// Looked up in parallel as soon as Wi-Fi associates, so the first real connections skip DNS.
+const char* const warmUpHosts[] = { "discord.com", "gateway.discord.gg", "api.telegram.org" };
+bool bootSequenceStarted = false;
+bool bootReported = false;
+
+// Cached TLS connections unused for this long are closed
+const unsigned long CONNECTION_IDLE_TIMEOUT = 60000;
+unsigned long lastConnectionExpiry = 0;
+// How often the PC is pinged for the bot's presence
+const unsigned long PRESENCE_POLL_INTERVAL = 30000;
+unsigned long lastPresencePoll = 0;
+
+void discordWarmUpTask(void* parameter) {
+    if (discord.warmUp()) {
+        Boot::mark(Boot::Phase::TLS);
+    }
+    vTaskDelete(nullptr);
+}
+
+void startBootSequence() {
+    if (bootSequenceStarted) return;
+    bootSequenceStarted = true;
+
+    Boot::mark(Boot::Phase::WiFi);
+    // Lets cached gateway URLs and saved sessions be aged properly after a power cycle.
+    configTime(0, 0, "pool.ntp.org");
+    Boot::resolveHosts(warmUpHosts, sizeof(warmUpHosts) / sizeof(warmUpHosts[0]));
+    xTaskCreate(discordWarmUpTask, "DiscordWarmUpTask", 8 * 1024, nullptr, tskIDLE_PRIORITY + 1, nullptr);
+}
+
+void on_discord_event(Discord::Bot::Event type, const JsonDocument& json) {
+    switch (type) {
+        case Discord::Bot::Event::Hello:
+            Boot::mark(Boot::Phase::Hello);
+            break;
+        case Discord::Bot::Event::Ready:
+        case Discord::Bot::Event::Resumed:
+            Boot::mark(Boot::Phase::Ready);
+            break;
+        default:
+            break;
+    }
+}
 
 // ===== COMMON FUNCTIONS =====
 bool update_wifi_status() 
@@ -60,12 +167,12 @@ bool update_wifi_status()
     if (wifiMulti.run() == WL_CONNECTED) {
         if (broadcastAddrSet) return true;
 
+        startBootSequence();
+
         IPAddress broadcastAddr = WOL.calculateBroadcastAddress(WiFi.localIP(), WiFi.subnetMask());
-        Serial.print("[WIFI] Broadcast address set to ");
-        broadcastAddr.printTo(Serial);
-        Serial.println();
+        LOG_I("[WIFI] Broadcast address set to %s", broadcastAddr.toString());
         broadcastAddrSet = true;
-        Serial.println("[WIFI] Wi-Fi connection established.");
+        LOG_I("[WIFI] Wi-Fi connection established.");
         return true;
     }
     broadcastAddrSet = false;
@@ -87,29 +194,134 @@ String getWANIP() {
     return payload;
 }
 
-String checkStatus(const char* name, const char* ip) {
-    static String msg;
+// Writes the status line into the caller's buffer, which is returned for convenience.
+const char* checkStatus(const char* name, const char* ip, char* buffer, size_t size) {
     IPAddress target;
     if (!target.fromString(ip)) {
-        msg = String("[ERROR] Invalid IP for ") + name;
-        return msg;
+        snprintf(buffer, size, "[ERROR] Invalid IP for %s", name);
+        return buffer;
     }
 
     if (Ping.ping(target, 1)) {
-        msg = String(name) + " is ONLINE";
+        snprintf(buffer, size, "%s is ONLINE", name);
     } else {
-        msg = String(name) + " is OFFLINE";
+        snprintf(buffer, size, "%s is OFFLINE", name);
     }
-    return msg;
+    return buffer;
+}
+
+// Webhooks are posted through the cached connection to this host, so only the URL's path is needed.
+// Named rather than DISCORD_API_HOSTNAME, which points at the simulator in esp32dev-sim.
+#define WEBHOOK_HOST "discord.com"
+
+// The path of discordWebhookURL, or nullptr unless it is a webhook on WEBHOOK_HOST. The URL is empty until one
+// is configured, so its prefix is compared before anything past it is read.
+const char* webhookPath() {
+    static const char prefix[] = "https://" WEBHOOK_HOST "/";
+    if (strncmp(discordWebhookURL, prefix, sizeof(prefix) - 1) != 0) return nullptr;
+    return discordWebhookURL + sizeof(prefix) - 2;
+}
+
+#define TRACE_BOUNDARY "wakeoncommand-trace"
+
+// Posts the trace to the webhook as trace.bin, for tools/trace2chrome.py. Call only once webhookPath() is known
+// to be set.
+bool postTrace() {
+
+    static const char head[] = "--" TRACE_BOUNDARY "\r\n"
+        "Content-Disposition: form-data; name=\"files[0]\"; filename=\"trace.bin\"\r\n"
+        "Content-Type: application/octet-stream\r\n\r\n";
+    static const char tail[] = "\r\n--" TRACE_BOUNDARY "--\r\n";
+    uint8_t* body = static_cast<uint8_t*>(malloc(sizeof(head) - 1 + Trace::maxSize() + sizeof(tail) - 1));
+    if (!body) return false;
+
+    memcpy(body, head, sizeof(head) - 1);
+    size_t length = sizeof(head) - 1;
+    length += Trace::serialize(body + length, Trace::maxSize());
+    memcpy(body + length, tail, sizeof(tail) - 1);
+    length += sizeof(tail) - 1;
+
+    Discord::ConnectionCache::Lease connection = Discord::connectionCache.acquire(WEBHOOK_HOST);
+    HTTPClient& http = connection.http();
+    http.setURL(webhookPath());
+    http.addHeader("Content-Type", "multipart/form-data; boundary=" TRACE_BOUNDARY);
+    int httpCode = http.POST(body, length);
+    if (httpCode > 0) http.getString();
+    free(body);
+    return httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_NO_CONTENT;
 }
 
 // ===== DISCORD HANDLER =====
-void on_discord_interaction(const char* name, const JsonObject& interaction) {
-    Serial.println("[DISCORD] Interaction received.");
+// Buttons under a wake or status message. Their custom ids name the host, as in "wake:pc" and "status:pc".
+struct HostButtons {
+    char wakeId[24];
+    char statusId[24];
+    Discord::Bot::MessageResponse::Button buttons[2];
+    size_t length = 0;
+
+    explicit HostButtons(const Host& host) {
+        snprintf(wakeId, sizeof(wakeId), "wake:%s", host.name);
+        snprintf(statusId, sizeof(statusId), "status:%s", host.name);
+        if (*host.mac) {
+            buttons[length++] = { "Wake", wakeId, Discord::Bot::MessageResponse::Button::Style::PRIMARY, false };
+        }
+        buttons[length++] = { "Check status", statusId, Discord::Bot::MessageResponse::Button::Style::SECONDARY, false };
+    }
 
-    if (strcmp(name, "ping") == 0) {
+    void attach(Discord::Bot::MessageResponse& response) const {
+        response.buttons = buttons;
+        response.buttonsLength = length;
+    }
+};
+
+// Buttons edit the message they are on, so pressing one again doesn't pile up new messages.
+void on_discord_button(const char* customId, const Discord::Interaction& interaction) {
+    const char* separator = strchr(customId, ':');
+    const Host* host = separator ? findHost(separator + 1) : nullptr;
+    Discord::Bot::MessageResponse response;
+    if (!host) {
+        // Acknowledged all the same, or Discord reports the press as failed.
+        discord.sendCommandResponse(Discord::Bot::InteractionResponse::DEFERRED_UPDATE_MESSAGE, response);
+        return;
+    }
+
+    HostButtons buttons(*host);
+    buttons.attach(response);
+    char content[48];
+    if (strncmp(customId, "wake:", 5) == 0 && *host->mac) {
+        if (!access.allowsDiscord("wake", interaction.userId(), interaction.roles())) {
+            Discord::Bot::MessageResponse denied;
+            denied.content = "Access denied.";
+            denied.flags = Discord::Bot::MessageResponse::Flags::EPHEMERAL;
+            discord.sendCommandResponse(Discord::Bot::InteractionResponse::CHANNEL_MESSAGE_WITH_SOURCE, denied);
+            return;
+        }
+        snprintf(content, sizeof(content), "Magic packet sent to %s again.", host->name);
+        response.content = content;
+        discord.sendCommandResponse(Discord::Bot::InteractionResponse::UPDATE_MESSAGE, response);
+        bool sent = WOL.sendMagicPacket(host->mac);
+        TRACE_EVENT(WolSent, sent);
+        if (!sent) {
+            LOG_W("[WOL] Packet failed to send.");
+        }
+    }
+    else {
+        // A single ping fits in Discord's 3 s window, so the message is updated in one response, as /pcstatus
+        // does. Deferring and then editing would need a second response slot the interaction wasn't admitted with.
+        response.content = checkStatus(host->name, host->ip, content, sizeof(content));
+        discord.sendCommandResponse(Discord::Bot::InteractionResponse::UPDATE_MESSAGE, response);
+    }
+}
+
+void on_discord_interaction(const char* name, const Discord::Interaction& interaction) {
+    LOG_I("[DISCORD] Interaction received.");
+
+    if (interaction.type() == Discord::Interaction::Type::MESSAGE_COMPONENT) {
+        on_discord_button(name, interaction);
+    }
+    else if (strcmp(name, "ping") == 0) {
         Discord::Bot::MessageResponse response;
-        response.content = String("Bot uplink online.");
+        response.content = "Bot uplink online.";
         discord.sendCommandResponse(
             Discord::Bot::InteractionResponse::CHANNEL_MESSAGE_WITH_SOURCE,
             response
@@ -117,32 +329,34 @@ void on_discord_interaction(const char* name, const JsonObject& interaction) {
     }
     else if (strcmp(name, "wake") == 0) {
         Discord::Bot::MessageResponse response;
-        uint64_t id;
-        if (interaction.containsKey("member")) {
-            id = interaction["member"]["user"]["id"];
-        } else {
-            id = interaction["user"]["id"];
-        }
+        const Host* host = findHost(interaction.getString("host", hosts[0].name));
 
-        bool authorised = false;
-        for (int i = 0; i < sizeof(botOwnerIds) / sizeof(botOwnerIds[0]); ++i) {
-            if (id != botOwnerIds[i]) continue;
-
-            authorised = true;
-            response.content = String("Magic packet sent");
+        if (!host || !*host->mac) {
+            response.content = "Unknown host, or it can't be woken.";
+            response.flags = Discord::Bot::MessageResponse::Flags::EPHEMERAL;
             discord.sendCommandResponse(
                 Discord::Bot::InteractionResponse::CHANNEL_MESSAGE_WITH_SOURCE,
                 response
             );
-            if (WOL.sendMagicPacket(macAddress)) {
-                Serial.println("[WOL] Packet sent.");
+        }
+        else if (access.allowsDiscord(name, interaction.userId(), interaction.roles())) {
+            HostButtons buttons(*host);
+            buttons.attach(response);
+            response.content = "Magic packet sent";
+            discord.sendCommandResponse(
+                Discord::Bot::InteractionResponse::CHANNEL_MESSAGE_WITH_SOURCE,
+                response
+            );
+            bool sent = WOL.sendMagicPacket(host->mac);
+            TRACE_EVENT(WolSent, sent);
+            if (sent) {
+                LOG_I("[WOL] Packet sent.");
             } else {
-                Serial.println("[WOL] Packet failed to send.");
+                LOG_W("[WOL] Packet failed to send.");
             }
         }
-
-        if (!authorised) {
-            response.content = String("Access denied.");
+        else {
+            response.content = "Access denied.";
             response.flags = Discord::Bot::MessageResponse::Flags::EPHEMERAL;
             discord.sendCommandResponse(
                 Discord::Bot::InteractionResponse::CHANNEL_MESSAGE_WITH_SOURCE,
@@ -152,8 +366,9 @@ void on_discord_interaction(const char* name, const JsonObject& interaction) {
     }
     else if (strcmp(name, "wanip") == 0) {
         Discord::Bot::MessageResponse response;
-        String wanIP = getWANIP();  
-        response.content = "Current WAN IP: " + wanIP;
+        char content[64];
+        snprintf(content, sizeof(content), "Current WAN IP: %s", getWANIP().c_str());
+        response.content = content;
         discord.sendCommandResponse(
             Discord::Bot::InteractionResponse::CHANNEL_MESSAGE_WITH_SOURCE,
             response
@@ -161,192 +376,402 @@ void on_discord_interaction(const char* name, const JsonObject& interaction) {
     }
     else if (strcmp(name, "pcstatus") == 0) {
         Discord::Bot::MessageResponse response;
-        response.content = checkStatus("PC", PCTargetIP);
+        char content[48];
+        const Host* host = findHost(interaction.getString("host", hosts[0].name));
+        if (!host) {
+            response.content = "Unknown host.";
+            discord.sendCommandResponse(
+                Discord::Bot::InteractionResponse::CHANNEL_MESSAGE_WITH_SOURCE,
+                response
+            );
+            return;
+        }
+        HostButtons buttons(*host);
+        buttons.attach(response);
+        response.content = checkStatus(host->name, host->ip, content, sizeof(content));
+        discord.sendCommandResponse(
+            Discord::Bot::InteractionResponse::CHANNEL_MESSAGE_WITH_SOURCE,
+            response
+        );
+    }
+    else if (strcmp(name, "trace") == 0) {
+        Discord::Bot::MessageResponse response;
+        response.flags = Discord::Bot::MessageResponse::Flags::EPHEMERAL;
+        bool allowed = access.allowsDiscord(name, interaction.userId(), interaction.roles());
+        bool configured = webhookPath() != nullptr;
+        response.content = !allowed ? "Access denied."
+            : configured ? "Posting the trace to the webhook." : "No webhook configured.";
         discord.sendCommandResponse(
             Discord::Bot::InteractionResponse::CHANNEL_MESSAGE_WITH_SOURCE,
             response
         );
+        // Answered first, since the upload can take longer than Discord waits for a response.
+        if (allowed && configured && !postTrace()) {
+            LOG_W("[TRACE] Failed to post the trace to the webhook.");
+        }
     }
     // else if (strcmp(name, "psstatus") == 0) {
     //     Discord::Bot::MessageResponse response;
-    //     response.content = checkStatus("PS", PSTargetIP);
+    //     char content[48];
+    //     response.content = checkStatus("PS", PSTargetIP, content, sizeof(content));
     //     discord.sendCommandResponse(
     //         Discord::Bot::InteractionResponse::CHANNEL_MESSAGE_WITH_SOURCE,
     //         response
     //     );
     // }
+}
+
+Discord::Interactions::ApplicationCommand chatCommand(const char* name, const char* description,
+    Discord::Interactions::ApplicationCommand::Option* options = nullptr, size_t optionsLength = 0) {
+    Discord::Interactions::ApplicationCommand command;
+    command.name = name;
+    command.type = Discord::Interactions::CommandType::CHAT_INPUT;
+    command.description = description;
+    command.options = options;
+    command.optionsLength = optionsLength;
+    command.default_member_permissions = 0;
+    return command;
+}
 
-    vTaskDelay(500);
+Discord::Interactions::ApplicationCommand::Option hostOption() {
+    Discord::Interactions::ApplicationCommand::Option option;
+    option.name = "host";
+    option.description = "Which host, pc if left out.";
+    option.type = Discord::Interactions::ApplicationCommand::OptionType::STRING;
+    option.required = false;
+    option.choices = nullptr;
+    option.autocomplete = true;
+    return option;
 }
 
+Discord::Interactions::ApplicationCommand::Option hostOptions[] = { hostOption() };
+
+// Registered as slash commands, and answered as text commands (!wake) in DMs.
+const Discord::Interactions::ApplicationCommand commands[] = {
+    chatCommand("ping", "Ping the bot for a response."),
+    chatCommand("wake", "Send wake signal to PC.", hostOptions, 1),
+    chatCommand("wanip", "Get WAN IP address."),
+    chatCommand("pcstatus", "Check if PC is online.", hostOptions, 1),
+    chatCommand("trace", "Post a trace of recent activity to the webhook."),
+    // chatCommand("psstatus", "Check if PS is online."),
+};
+
 void registerCommands() {
-    Serial.println("Registering commands...");
-    Discord::Interactions::ApplicationCommand cmd;
-
-    cmd.name = "ping";
-    cmd.type = Discord::Interactions::CommandType::CHAT_INPUT;
-    cmd.description = "Ping the bot for a response.";
-    Discord::Interactions::registerGlobalCommand(discord.applicationId(), cmd, botToken);
-
-    cmd.name = "wake";
-    cmd.type = Discord::Interactions::CommandType::CHAT_INPUT;
-    cmd.description = "Send wake signal to PC.";
-    Discord::Interactions::registerGlobalCommand(discord.applicationId(), cmd, botToken);
-
-    cmd.name = "wanip";
-    cmd.type = Discord::Interactions::CommandType::CHAT_INPUT;
-    cmd.description = "Get WAN IP address.";
-    Discord::Interactions::registerGlobalCommand(discord.applicationId(), cmd, botToken);
-
-    cmd.name = "pcstatus";
-    cmd.description = "Check if PC is online.";
-    Discord::Interactions::registerGlobalCommand(discord.applicationId(), cmd, botToken);
-
-    // cmd.name = "psstatus";
-    // cmd.description = "Check if PS is online.";
-    // Discord::Interactions::registerGlobalCommand(discord.applicationId(), cmd, botToken);
+    LOG_I("Registering commands...");
+    for (const Discord::Interactions::ApplicationCommand& command : commands) {
+        Discord::Interactions::registerGlobalCommand(discord.applicationId(), command, botToken);
+    }
 }
 
 // ===== TELEGRAM HANDLER =====
-bool isAuthorized(String chat_id) {
-  for (int i = 0; i < sizeof(telegramOwnerIds) / sizeof(telegramOwnerIds[0]); ++i) {
-    if (chat_id == String(telegramOwnerIds[i])) return true;
+bool queueTelegramMessage(const char* chatId, const char* text) {
+  TelegramReply reply;
+  strlcpy(reply.chatId, chatId, sizeof(reply.chatId));
+  strlcpy(reply.text, text, sizeof(reply.text));
+  reply.queuedAt = millis();
+  if (xQueueSend(telegramOutbox, &reply, 0) != pdTRUE) {
+    LOG_W("[TELEGRAM] Outbox full, reply dropped.");
+    ++telegramSendFailures;
+    return false;
   }
-  return false;
+  return true;
 }
 
-void handleNewMessages(int numNewMessages) {
-  for (int i = 0; i < numNewMessages; i++) {
-    String chat_id = String(telegramBot.messages[i].chat_id);
-    String text = telegramBot.messages[i].text;
-    Serial.printf("[TELEGRAM] Received: %s from %s\n", text.c_str(), chat_id.c_str());
-
-    if (text == "/ping") {
-      telegramBot.sendMessage(chat_id, "ESP uplink online.", "");
-    } 
-    else if (text == "/wanip") {
-      telegramBot.sendMessage(chat_id, "WAN IP is: " + getWANIP(), "");
-    } 
-    else if (text == "/wake") {
-      if (isAuthorized(chat_id)) {
-        if (WOL.sendMagicPacket(macAddress)) {
-          telegramBot.sendMessage(chat_id, "Magic packet sent", "");
-        } else {
-          telegramBot.sendMessage(chat_id, "Failed to send magic packet.", "");
-        }
+// Waits until every queued reply has been handed to Telegram, or the timeout expires.
+bool flushTelegramOutbox(unsigned long timeout) {
+  unsigned long start = millis();
+  while (uxQueueMessagesWaiting(telegramOutbox) > 0 || telegramSending) {
+    if (millis() - start > timeout) return false;
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+  return true;
+}
+
+void handleNewMessage(const TelegramMessage& message) {
+  String text = message.text;
+  LOG_I("[TELEGRAM] Received: %s from %s", message.text, message.chatId);
+
+  if (text == "/ping") {
+    queueTelegramMessage(message.chatId, "ESP uplink online.");
+  } 
+  else if (text == "/wanip") {
+    char reply[64];
+    snprintf(reply, sizeof(reply), "WAN IP is: %s", getWANIP().c_str());
+    queueTelegramMessage(message.chatId, reply);
+  } 
+  else if (text == "/wake") {
+    if (access.allowsTelegram("wake", message.chatId)) {
+      bool sent = WOL.sendMagicPacket(macAddress);
+      TRACE_EVENT(WolSent, sent);
+      if (sent) {
+        queueTelegramMessage(message.chatId, "Magic packet sent");
       } else {
-        telegramBot.sendMessage(chat_id, "Access denied.", "");
+        queueTelegramMessage(message.chatId, "Failed to send magic packet.");
       }
+    } else {
+      queueTelegramMessage(message.chatId, "Access denied.");
     }
-    else if (text == "/pcstatus") {
-      telegramBot.sendMessage(chat_id, checkStatus("PC", PCTargetIP), "");
+  }
+  else if (text == "/pcstatus") {
+    char reply[48];
+    queueTelegramMessage(message.chatId, checkStatus("PC", PCTargetIP, reply, sizeof(reply)));
+  }
+  // else if (text == "/psstatus") {
+  //   char reply[48];
+  //   queueTelegramMessage(message.chatId, checkStatus("PS", PSTargetIP, reply, sizeof(reply)));
+  // }
+  // else if (text == "/start") {
+  //     telegramEnabled = true;
+  //     botEnabled = false;  // tắt Discord
+  //     lastTelegramMessageTime = millis(); // reset timeout
+  //     telegramBot.sendMessage(chat_id, "Telegram bot is ON.\n Discord bot is OFF.", "");
+  // }
+  // else if (text == "/stop") {
+  //     telegramEnabled = false;
+  //     botEnabled = true;   // bật lại Discord khi Telegram tắt
+  //     telegramBot.sendMessage(chat_id, "Telegram bot is OFF.\n Discord bot is ON.", "");
+  // }
+
+  else {
+    queueTelegramMessage(message.chatId, "Unknown command.");
+  }
+}
+
+void telegramPollTask(void* parameter) {
+    telegramPoller.longPoll = TELEGRAM_LONG_POLL;
+
+    for (;;) {
+        if (WiFi.status() != WL_CONNECTED) {
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            continue;
+        }
+
+        // Blocks for up to TELEGRAM_LONG_POLL seconds, returning as soon as Telegram has an update for us.
+        int numNewMessages = telegramPoller.getUpdates(telegramPoller.last_message_received + 1);
+        for (int i = 0; i < numNewMessages; ++i) {
+            TelegramMessage message;
+            strlcpy(message.chatId, telegramPoller.messages[i].chat_id.c_str(), sizeof(message.chatId));
+            strlcpy(message.text, telegramPoller.messages[i].text.c_str(), sizeof(message.text));
+            if (xQueueSend(telegramInbox, &message, 0) != pdTRUE) {
+                LOG_W("[TELEGRAM] Inbox full, message dropped.");
+            }
+        }
+
+        if (numNewMessages == 0) {
+            // Either the long poll timed out or the request failed; avoid spinning on a dead connection.
+            vTaskDelay(pdMS_TO_TICKS(100));
+        }
     }
-    // else if (text == "/psstatus") {
-    //   telegramBot.sendMessage(chat_id, checkStatus("PS", PSTargetIP), "");
-    // }
-    // else if (text == "/start") {
-    //     telegramEnabled = true;
-    //     botEnabled = false;  // tắt Discord
-    //     lastTelegramMessageTime = millis(); // reset timeout
-    //     telegramBot.sendMessage(chat_id, "Telegram bot is ON.\n Discord bot is OFF.", "");
-    // }
-    // else if (text == "/stop") {
-    //     telegramEnabled = false;
-    //     botEnabled = true;   // bật lại Discord khi Telegram tắt
-    //     telegramBot.sendMessage(chat_id, "Telegram bot is OFF.\n Discord bot is ON.", "");
-    // }
+}
 
-    else {
-      telegramBot.sendMessage(chat_id, "Unknown command.", "");
+void telegramSendTask(void* parameter) {
+    TelegramReply batch[TELEGRAM_OUTBOX_LENGTH];
+
+    // Open the connection while nothing is waiting on it, so the first reply doesn't pay for the handshake.
+    while (WiFi.status() != WL_CONNECTED) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    secured_client.connect(TELEGRAM_HOST, TELEGRAM_SSL_PORT);
+
+    for (;;) {
+        if (xQueueReceive(telegramOutbox, &batch[0], portMAX_DELAY) != pdTRUE) continue;
+        telegramSending = true;
+
+        // Take whatever else is already waiting so replies to the same chat can share one request.
+        size_t count = 1;
+        while (count < TELEGRAM_OUTBOX_LENGTH && xQueueReceive(telegramOutbox, &batch[count], 0) == pdTRUE) {
+            ++count;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (batch[i].chatId[0] == '\0') continue; // Already merged into an earlier reply
+
+            String text = batch[i].text;
+            size_t merged = 1;
+            for (size_t j = i + 1; j < count; ++j) {
+                if (strcmp(batch[i].chatId, batch[j].chatId) != 0) continue;
+                text += "\n";
+                text += batch[j].text;
+                batch[j].chatId[0] = '\0';
+                ++merged;
+            }
+
+            unsigned long sendStart = millis();
+            bool sent = telegramBot.sendMessage(batch[i].chatId, text, "");
+            unsigned long sendEnd = millis();
+
+            if (sent) {
+                telegramMessagesSent += merged;
+                LOG_I("[TELEGRAM] Sent %u message(s) to %s in %lu ms (%lu ms after queueing).",
+                    merged, batch[i].chatId, sendEnd - sendStart, sendEnd - batch[i].queuedAt);
+            }
+            else {
+                telegramSendFailures += merged;
+                LOG_W("[TELEGRAM] Failed to send %u message(s) to %s after %lu ms. Total failures: %lu",
+                    merged, batch[i].chatId, sendEnd - sendStart, telegramSendFailures);
+            }
+        }
+
+        telegramSending = false;
     }
-  }
 }
 
-// ===== AUTO RESET CONFIG =====
-const unsigned long RESET_INTERVAL = 8UL * 60UL * 60UL * 1000UL; // 5 tiếng
-//const unsigned long RESET_INTERVAL = 1UL * 60UL * 1000UL; // 1 phút
-unsigned long startTime = 0;  
+// ===== SELF-HEALING CONFIG =====
+// Restarts only when the heap, gateway or handlers are unhealthy, and only once nothing is in flight.
+Health::Supervisor health(discord);
 
 void sendResetNotification() {
-    Serial.println("[SYSTEM] Sending reset notification...");
-
-    HTTPClient http;
-    http.begin(discordWebhookURL);
-    http.addHeader("Content-Type", "application/json");
-    String payload = "{\"content\":\"Bot is restarting \"}";
-    int httpCode = http.POST(payload);
-    http.end();
+    LOG_I("[SYSTEM] Sending reset notification...");
+
+    if (const char* path = webhookPath()) {
+        Discord::ConnectionCache::Lease connection = Discord::connectionCache.acquire(WEBHOOK_HOST);
+        HTTPClient& http = connection.http();
+        http.setURL(path);
+        http.addHeader("Content-Type", "application/json");
+        int httpCode = http.POST("{\"content\":\"Bot is restarting \"}");
+        // Drain the body so the connection can be reused.
+        if (httpCode > 0) http.getString();
+        if (httpCode != HTTP_CODE_OK && httpCode != HTTP_CODE_NO_CONTENT) {
+            LOG_W("[SYSTEM] Reset notification failed: %d", httpCode);
+        }
+    }
 
     if (telegramEnabled) {
         for (int i = 0; i < sizeof(telegramOwnerIds) / sizeof(telegramOwnerIds[0]); i++) {
-            telegramBot.sendMessage(String(telegramOwnerIds[i]), "Bot is restarting", "");
+            queueTelegramMessage(telegramOwnerIds[i], "Bot is restarting");
         }
     }
+    flushTelegramOutbox(5000);
 }
 
 
 // ===== SETUP =====
 void setup() {
     Serial.begin(115200);
-    Serial.println("[STATUS] Standby.");
-    Serial.print("[CONFIG] Target MAC address: ");
-    Serial.println(macAddress);
-    Serial.print("[CONFIG] Default network: ");
-    Serial.println(wifiSSID);
+    Log::begin(Serial);
+    LOG_I("[STATUS] Standby.");
+    LOG_I("[CONFIG] Target MAC address: %s", macAddress);
+    LOG_I("[CONFIG] Default network: %s", wifiSSID);
     wifiMulti.addAP(wifiSSID, wifiPassword);
 
+    Authorization::Config accessConfig;
+    accessConfig.users = botOwnerIds;
+    accessConfig.usersLength = sizeof(botOwnerIds) / sizeof(botOwnerIds[0]);
+    accessConfig.roles = botOperatorRoleIds;
+    accessConfig.rolesLength = sizeof(botOperatorRoleIds) / sizeof(botOperatorRoleIds[0]);
+    accessConfig.telegramChats = telegramOwnerIds;
+    accessConfig.telegramChatsLength = sizeof(telegramOwnerIds) / sizeof(telegramOwnerIds[0]);
+    accessConfig.rules = accessRules;
+    accessConfig.rulesLength = sizeof(accessRules) / sizeof(accessRules[0]);
+    access.begin(accessConfig);
+    access.report();
+
     secured_client.setInsecure();
+    telegram_poll_client.setInsecure();
+    telegramInbox = xQueueCreate(TELEGRAM_INBOX_LENGTH, sizeof(TelegramMessage));
+    telegramOutbox = xQueueCreate(TELEGRAM_OUTBOX_LENGTH, sizeof(TelegramReply));
+    xTaskCreate(telegramPollTask, "TelegramPollTask", 8 * 1024, nullptr, tskIDLE_PRIORITY + 1, nullptr);
+    xTaskCreate(telegramSendTask, "TelegramSendTask", 8 * 1024, nullptr, tskIDLE_PRIORITY + 1, nullptr);
+
+    if (esp_reset_reason() == ESP_RST_SW && commandsRegisteredMagic == COMMANDS_REGISTERED_MAGIC) {
+        commandsRegistered = true;
+        LOG_I("[DISCORD] Commands already registered before restart.");
+    }
+    commandsRegisteredMagic = 0;
+
+    // Only what boot timing needs; interactions arrive without any intents.
+    discord.onEvent(on_discord_event, {
+        Discord::Bot::Event::Hello, Discord::Bot::Event::Ready, Discord::Bot::Event::Resumed });
     discord.onInteraction(on_discord_interaction);
+    discord.setTextCommands("!", commands, sizeof(commands) / sizeof(commands[0]));
+    hostIndex.begin(hostNames, sizeof(hostNames) / sizeof(hostNames[0]));
+    discord.addAutocomplete("wake", "host", hostIndex);
+    discord.addAutocomplete("pcstatus", "host", hostIndex);
+#ifdef DISCORD_CAPTURE_GATEWAY
+    // Build with -D DISCORD_CAPTURE_GATEWAY and save the monitor output to replay the traffic on the host.
+    discord.captureTo(&Serial);
+#endif
+    if (botEnabled) {
+        // Gateway I/O on core 0, command handlers on core 1 alongside this loop.
+        // Intents are worked out from the subscriptions above.
+        discord.begin();
+    }
 
-    startTime = millis(); 
+    health.begin();
 }
 
 
 void loop() {
+    // Send t over serial for a trace dump, see tools/trace2chrome.py.
+    if (Serial.available() && Serial.read() == 't') {
+        Log::flush();
+        Trace::dump(Serial);
+    }
+
     if (!update_wifi_status()) {
-        Serial.println("[WIFI] Not connected.");
+        LOG_W("[WIFI] Not connected.");
         delay(1000);
         return;
     }
 
-    // ===== Discord Handling =====
-    if (botEnabled) {
-        if (!discord.online() && millis() > lastLoginAttempt) {
-            lastLoginAttempt = millis() + LOGIN_INTERVAL;
-            discord.login(4096);
-        }
+    if (!bootReported && Boot::elapsed(Boot::Phase::Ready) > 0) {
+        LOG_I("[BOOT] Ready to answer commands.");
+        Boot::report();
+        bootReported = true;
+    }
 
-        discord.update(millis());
+    // Give back the TLS buffers of connections nobody has needed for a while.
+    if (millis() - lastConnectionExpiry > CONNECTION_IDLE_TIMEOUT) {
+        Discord::connectionCache.expire(CONNECTION_IDLE_TIMEOUT);
+        Discord::connectionCache.logStats();
+        lastConnectionExpiry = millis();
+    }
 
+    // ===== Discord Handling =====
+    if (botEnabled) {
         if (discord.online() && !commandsRegistered) {
             registerCommands();
             commandsRegistered = true;
-            Serial.println("[DISCORD] Commands registration attempted.");
+            LOG_I("[DISCORD] Commands registration attempted.");
+        }
+
+        // The client only sends this when it changes, so polling often costs nothing on the gateway.
+        if (discord.online() && millis() - lastPresencePoll > PRESENCE_POLL_INTERVAL) {
+            IPAddress target;
+            if (target.fromString(PCTargetIP)) {
+                bool up = Ping.ping(target, 1);
+                discord.setPresence(Discord::Bot::Status::ONLINE, Discord::Bot::ActivityType::WATCHING,
+                    up ? "the PC, online" : "the PC, offline");
+            }
+            lastPresencePoll = millis();
         }
     }
 
     // ===== Telegram Handling =====
-    if (millis() - lastCheckTime > botPollingInterval) {
-        int numNewMessages = telegramBot.getUpdates(telegramBot.last_message_received + 1);
-        if (numNewMessages) {
-            handleNewMessages(numNewMessages);
-            lastTelegramMessageTime = millis();
-        }
-        lastCheckTime = millis();
+    TelegramMessage message;
+    while (xQueueReceive(telegramInbox, &message, 0) == pdTRUE) {
+        handleNewMessage(message);
+        lastTelegramMessageTime = millis();
     }
 
     /*
     if (telegramEnabled && (millis() - lastTelegramMessageTime > TELEGRAM_TIMEOUT)) {
         telegramEnabled = false;
         botEnabled = true;
-        Serial.println("[TELEGRAM] Timeout, no new messages, turn OFF Telegram bot, turn ON Discord.");
+        LOG_W("[TELEGRAM] Timeout, no new messages, turn OFF Telegram bot, turn ON Discord.");
     }
     */
 
-    if (millis() - startTime >= RESET_INTERVAL) {
-        Serial.println("[SYSTEM] 5 hours passed -> Restarting Bot...");
+    bool telegramBusy = uxQueueMessagesWaiting(telegramOutbox) > 0 || uxQueueMessagesWaiting(telegramInbox) > 0
+        || telegramSending;
+    if (health.update(millis(), telegramBusy)) {
+        LOG_W("[SYSTEM] Restarting Bot: %s", health.reason());
         sendResetNotification();
         delay(2000);
+        // Deliberately no logout: closing the socket cleanly would invalidate the session we want to resume.
+        discord.saveResumeState();
+        if (commandsRegistered) commandsRegisteredMagic = COMMANDS_REGISTERED_MAGIC;
+        Log::flush();
         ESP.restart();
     }
 }
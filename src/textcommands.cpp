@@ -0,0 +1,99 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <textcommands.h>
+#include <log.h>
+#include <ctype.h>
+
+#define TEXT_COMMANDS_MESSAGE_PREFIX "[DISCORD][TEXT] "
+
+namespace Discord {
+    namespace {
+        bool isBlank(char c) {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+    }
+
+    bool CommandTrie::build(const Interactions::ApplicationCommand* commands, size_t length) {
+        _commands = commands;
+        // The root
+        _nodes[0] = { '\0', 0, 0, 0 };
+        _length = 1;
+
+        bool complete = true;
+        for (size_t i = 0; i < length && i < UINT8_MAX; ++i) {
+            uint16_t node = 0;
+            const char* c = commands[i].name;
+            for (; *c; ++c) {
+                char label = tolower(static_cast<unsigned char>(*c));
+                uint16_t child = _nodes[node].child;
+                while (child && _nodes[child].label != label) child = _nodes[child].sibling;
+                if (!child) {
+                    if (_length == DISCORD_COMMAND_TRIE_NODES) break;
+                    child = _length++;
+                    _nodes[child] = { label, 0, 0, _nodes[node].child };
+                    _nodes[node].child = child;
+                }
+                node = child;
+            }
+            if (*c) {
+                LOG_W(TEXT_COMMANDS_MESSAGE_PREFIX "No room left for command %s.", commands[i].name);
+                complete = false;
+                continue;
+            }
+            if (node) _nodes[node].command = i + 1;
+        }
+        return complete;
+    }
+
+    const Interactions::ApplicationCommand* CommandTrie::match(const char* text, size_t& length) const {
+        if (_length == 0) return nullptr;
+        uint16_t node = 0;
+        size_t i = 0;
+        for (; text[i] && !isBlank(text[i]); ++i) {
+            char label = tolower(static_cast<unsigned char>(text[i]));
+            uint16_t child = _nodes[node].child;
+            while (child && _nodes[child].label != label) child = _nodes[child].sibling;
+            if (!child) return nullptr;
+            node = child;
+        }
+        if (!_nodes[node].command) return nullptr;
+        length = i;
+        return &_commands[_nodes[node].command - 1];
+    }
+
+    Arguments::Arguments(const char* text) {
+        strlcpy(_buffer, text ? text : "", sizeof(_buffer));
+
+        char* c = _buffer;
+        while (_length < DISCORD_TEXT_COMMAND_ARGS) {
+            while (isBlank(*c)) ++c;
+            if (!*c) break;
+
+            char end = ' ';
+            if (*c == '"') {
+                end = '"';
+                ++c;
+            }
+            _arguments[_length++] = c;
+            while (*c && (end == '"' ? *c != '"' : !isBlank(*c))) ++c;
+            if (!*c) break;
+            *c++ = '\0';
+        }
+    }
+}
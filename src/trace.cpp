@@ -0,0 +1,140 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <trace.h>
+#include <atomic>
+
+#define TRACE_MESSAGE_PREFIX "[TRACE] "
+#define TRACE_VERSION 1
+#define TRACE_NAME_SIZE 16
+
+static_assert(sizeof(Trace::Record) == 12, "Trace records are dumped as they are in memory");
+
+namespace Trace {
+    namespace {
+        constexpr uint32_t slots = TRACE_EVENTS > 0 ? TRACE_EVENTS : 1;
+
+        Record records[slots];
+        // Total events ever recorded; the slot for the next one is this modulo slots
+        std::atomic<uint32_t> recorded { 0 };
+        std::atomic<bool> paused { false };
+
+        std::atomic<TaskHandle_t> tasks[TRACE_TASKS];
+        char taskNames[TRACE_TASKS][TRACE_NAME_SIZE];
+
+        // Tasks are few and long-lived, so a scan beats anything cleverer
+        uint8_t taskIndex() {
+            TaskHandle_t self = xTaskGetCurrentTaskHandle();
+            for (uint8_t i = 0; i < TRACE_TASKS; ++i) {
+                TaskHandle_t task = tasks[i].load(std::memory_order_acquire);
+                if (task == self) return i;
+                if (task == nullptr) {
+                    TaskHandle_t expected = nullptr;
+                    if (tasks[i].compare_exchange_strong(expected, self, std::memory_order_acq_rel)) {
+                        strlcpy(taskNames[i], pcTaskGetName(nullptr), TRACE_NAME_SIZE);
+                        return i;
+                    }
+                    // Another task took the slot first; keep looking
+                }
+            }
+            return TRACE_TASKS - 1;
+        }
+
+        uint8_t taskCount() {
+            uint8_t count = 0;
+            while (count < TRACE_TASKS && tasks[count].load(std::memory_order_acquire) != nullptr) ++count;
+            return count;
+        }
+
+        uint32_t eventCount() {
+            uint32_t total = recorded.load(std::memory_order_acquire);
+            return total < slots ? total : slots;
+        }
+
+        void put(uint8_t*& out, const void* value, size_t size) {
+            memcpy(out, value, size);
+            out += size;
+        }
+    }
+
+    void record(Event event, uint32_t arg) {
+        if (TRACE_EVENTS == 0 || paused.load(std::memory_order_relaxed)) return;
+        uint32_t index = recorded.fetch_add(1, std::memory_order_relaxed);
+        Record& record = records[index % slots];
+        record.time = micros();
+        record.arg = arg;
+        record.event = event;
+        record.task = taskIndex();
+    }
+
+    size_t maxSize() {
+        return 16 + TRACE_TASKS * TRACE_NAME_SIZE + slots * sizeof(Record);
+    }
+
+    size_t serialize(uint8_t* buffer, size_t capacity) {
+        paused.store(true, std::memory_order_relaxed);
+        uint16_t version = TRACE_VERSION;
+        uint16_t names = taskCount();
+        uint32_t events = eventCount();
+        uint32_t now = micros();
+
+        size_t written = 0;
+        if (capacity >= 16 + names * TRACE_NAME_SIZE + events * sizeof(Record)) {
+            uint8_t* out = buffer;
+            put(out, "DTRC", 4);
+            put(out, &version, sizeof(version));
+            put(out, &names, sizeof(names));
+            put(out, &events, sizeof(events));
+            put(out, &now, sizeof(now));
+            put(out, taskNames, names * TRACE_NAME_SIZE);
+
+            uint32_t first = recorded.load(std::memory_order_acquire) - events;
+            for (uint32_t i = 0; i < events; ++i) {
+                put(out, &records[(first + i) % slots], sizeof(Record));
+            }
+            written = out - buffer;
+        }
+        paused.store(false, std::memory_order_relaxed);
+        return written;
+    }
+
+    void dump(Print& out) {
+        size_t length = maxSize();
+        uint8_t* buffer = static_cast<uint8_t*>(malloc(length));
+        if (!buffer) {
+            out.println(TRACE_MESSAGE_PREFIX "Not enough memory to dump the trace.");
+            return;
+        }
+        length = serialize(buffer, length);
+
+        out.printf(TRACE_MESSAGE_PREFIX "begin %u\r\n", static_cast<unsigned int>(length));
+        char line[sizeof(TRACE_MESSAGE_PREFIX) + 64];
+        for (size_t offset = 0; offset < length; offset += 32) {
+            char* p = line + strlcpy(line, TRACE_MESSAGE_PREFIX, sizeof(line));
+            for (size_t i = offset; i < length && i < offset + 32; ++i) {
+                static const char hex[] = "0123456789abcdef";
+                *p++ = hex[buffer[i] >> 4];
+                *p++ = hex[buffer[i] & 0xF];
+            }
+            *p = '\0';
+            out.println(line);
+        }
+        out.println(TRACE_MESSAGE_PREFIX "end");
+        free(buffer);
+    }
+}
@@ -0,0 +1,140 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+// One producer and one consumer thread passing records through an EventRing, as the gateway and worker tasks do:
+//   pio test -e native -f test_event_ring
+
+#include <eventring.h>
+#include <unity.h>
+
+#include <atomic>
+#include <thread>
+
+// Enough laps of a small ring for the two threads to interleave every way they can
+#define TEST_RING_RECORDS 1000000UL
+#define TEST_RING_SIZE 8
+
+namespace {
+    struct Record {
+        uint32_t sequence;
+        void* frame;
+    };
+
+    typedef Discord::EventRing<Record, TEST_RING_SIZE> Ring;
+
+    // With Reject the producer retries until each record is stored, so every record must arrive, in order.
+    void test_reject_delivers_everything_in_order() {
+        Ring* ring = new Ring(Discord::RingPolicy::Reject);
+        unsigned long retries = 0;
+
+        std::thread producer([ring, &retries]() {
+            for (uint32_t sequence = 1; sequence <= TEST_RING_RECORDS; ++sequence) {
+                Record record { sequence, nullptr };
+                while (ring->push(record) == Discord::PushResult::Rejected) {
+                    ++retries;
+                    std::this_thread::yield();
+                }
+            }
+            });
+
+        uint32_t expected = 1;
+        uint32_t outOfOrder = 0;
+        Record record;
+        while (expected <= TEST_RING_RECORDS) {
+            if (!ring->pop(record)) {
+                std::this_thread::yield();
+                continue;
+            }
+            if (record.sequence != expected) ++outOfOrder;
+            expected = record.sequence + 1;
+        }
+        producer.join();
+
+        TEST_ASSERT_EQUAL_UINT32(0, outOfOrder);
+        TEST_ASSERT_EQUAL_UINT32(TEST_RING_RECORDS + 1, expected);
+        TEST_ASSERT_FALSE(ring->pop(record));
+        // Every rejection was a retry, and nothing else is counted as dropped
+        TEST_ASSERT_EQUAL_UINT32(retries, ring->dropped());
+        TEST_ASSERT_LESS_OR_EQUAL(TEST_RING_SIZE, ring->highWater());
+        delete ring;
+    }
+
+    // With Overwrite the producer never waits, so records go missing, but each one is either consumed or evicted,
+    // never both, and the survivors keep their order.
+    void test_overwrite_accounts_for_every_record() {
+        Ring* ring = new Ring(Discord::RingPolicy::Overwrite);
+        std::atomic<bool> produced { false };
+        unsigned long evicted = 0;
+        uint32_t evictedOutOfOrder = 0;
+
+        std::thread producer([ring, &produced, &evicted, &evictedOutOfOrder]() {
+            uint32_t lastEvicted = 0;
+            for (uint32_t sequence = 1; sequence <= TEST_RING_RECORDS; ++sequence) {
+                Record record { sequence, nullptr };
+                Record oldest;
+                if (ring->push(record, &oldest) == Discord::PushResult::Evicted) {
+                    ++evicted;
+                    // Evictions take the oldest record, so they come in order too
+                    if (oldest.sequence <= lastEvicted || oldest.sequence >= sequence) ++evictedOutOfOrder;
+                    lastEvicted = oldest.sequence;
+                }
+            }
+            produced = true;
+            });
+
+        unsigned long consumed = 0;
+        uint32_t last = 0;
+        uint32_t outOfOrder = 0;
+        Record record;
+        // Drain whatever is left once the producer is done, so nothing is counted as lost that wasn't.
+        for (;;) {
+            bool done = produced.load();
+            if (ring->pop(record)) {
+                if (record.sequence <= last) ++outOfOrder;
+                last = record.sequence;
+                ++consumed;
+            }
+            else if (done) {
+                break;
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+        producer.join();
+
+        TEST_ASSERT_EQUAL_UINT32(0, outOfOrder);
+        TEST_ASSERT_EQUAL_UINT32(0, evictedOutOfOrder);
+        TEST_ASSERT_EQUAL_UINT32(TEST_RING_RECORDS, consumed + evicted);
+        TEST_ASSERT_EQUAL_UINT32(evicted, ring->dropped());
+        // The newest record can never be evicted
+        TEST_ASSERT_EQUAL_UINT32(TEST_RING_RECORDS, last);
+        delete ring;
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_reject_delivers_everything_in_order);
+    RUN_TEST(test_overwrite_accounts_for_every_record);
+    return UNITY_END();
+}
@@ -0,0 +1,93 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+// Intents a feature requires have to reach the identify payload whatever intents the bot is started with.
+//   pio test -e native -f test_intents
+
+#include <Arduino.h>
+#include <discord.h>
+#include <interactions.h>
+#include <unity.h>
+
+namespace {
+    Discord::Interactions::ApplicationCommand commands[1];
+
+    // Never deleted: login() starts the responder task, which keeps using the bot.
+    Discord::Bot& newBot() {
+        return *new Discord::Bot("MTEwMDAwMDAwMDAwMDAwMDAwMA.Gtest.intents-token-not-a-real-one", 1100000000000000000ULL);
+    }
+
+    // Logs in with intents, answers HELLO, and returns the intents the identify that follows carries.
+    unsigned int identifiedIntents(Discord::Bot& bot, unsigned int intents) {
+        long identified = -1;
+        bot.login(intents);
+        WebSocketsClient* socket = WebSocketsClient::last;
+        socket->onSend = [&identified](const char* payload, size_t length) {
+            StaticJsonDocument<1024> frame;
+            if (deserializeJson(frame, payload, length) == DeserializationError::Ok && frame["op"] == 2) {
+                identified = frame["d"]["intents"].as<long>();
+            }
+        };
+        socket->receive(WStype_CONNECTED);
+        socket->hello();
+        socket->onSend = nullptr;
+
+        TEST_ASSERT_TRUE_MESSAGE(identified >= 0, "No identify was sent");
+        return static_cast<unsigned int>(identified);
+    }
+
+    void test_text_commands_add_direct_messages_automatically() {
+        Discord::Bot& bot = newBot();
+        bot.setTextCommands("!", commands, 1);
+        unsigned int intents = identifiedIntents(bot, Discord::Intents::AUTOMATIC);
+        TEST_ASSERT_BITS_HIGH(Discord::Intents::DIRECT_MESSAGES, intents);
+        TEST_ASSERT_EQUAL_UINT32(intents, bot.intents());
+    }
+
+    void test_text_commands_add_direct_messages_to_explicit_intents() {
+        Discord::Bot& bot = newBot();
+        bot.setTextCommands("!", commands, 1);
+        unsigned int intents = identifiedIntents(bot, Discord::Intents::GUILDS);
+        TEST_ASSERT_BITS_HIGH(Discord::Intents::DIRECT_MESSAGES | Discord::Intents::GUILDS, intents);
+    }
+
+    void test_explicit_intents_are_kept_without_requirements() {
+        Discord::Bot& bot = newBot();
+        unsigned int intents = identifiedIntents(bot, Discord::Intents::GUILDS);
+        TEST_ASSERT_EQUAL_UINT32(Discord::Intents::GUILDS, intents);
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+int main(int argc, char** argv) {
+    commands[0].name = "wake";
+    commands[0].type = Discord::Interactions::CommandType::CHAT_INPUT;
+    commands[0].description = "Send wake signal to PC.";
+    commands[0].options = nullptr;
+    commands[0].optionsLength = 0;
+    commands[0].default_member_permissions = 0;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_text_commands_add_direct_messages_automatically);
+    RUN_TEST(test_text_commands_add_direct_messages_to_explicit_intents);
+    RUN_TEST(test_explicit_intents_are_kept_without_requirements);
+    return UNITY_END();
+}
@@ -0,0 +1,132 @@
+/*
+ * ESP32-Discord-WakeOnCommand v0.1
+ * Copyright (C) 2023  Neo Ting Wei Terrence
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+// Command responses are built straight into preallocated slots, so answering an interaction must not touch the heap
+// on the handler's side; the responder task and HTTPClient are measured separately by the benchmarks.
+//   pio test -e native -f test_response_path
+
+#include <Arduino.h>
+#include <discord.h>
+#include <unity.h>
+
+#include <thread>
+
+#include "allocations.h"
+
+// Responses per case, after the first one has warmed up anything initialised lazily
+#define TEST_RESPONSES 32
+
+namespace {
+    char readyFrame[] =
+        "{\"t\":\"READY\",\"s\":1,\"op\":0,\"d\":{\"v\":10,\"session_id\":\"4a5d3c9e8f7b6a5d4c3b2a1f0e9d8c7b\","
+        "\"resume_gateway_url\":\"wss://gateway-us-east1-b.discord.gg\","
+        "\"application\":{\"id\":\"1100000000000000000\",\"flags\":565248}}}";
+
+    char interactionCreateFrame[] =
+        "{\"t\":\"INTERACTION_CREATE\",\"s\":2,\"op\":0,\"d\":{\"version\":1,\"type\":2,"
+        "\"token\":\"aW50ZXJhY3Rpb246MTE0MjM4MDAwMDAwMDAwMDAwNDpyZXNwb25zZXRlc3R0b2tlbnJlc3BvbnNldGVzdHRva2Vu\","
+        "\"member\":{\"user\":{\"username\":\"someone\",\"id\":\"1000000000000000003\"},"
+        "\"roles\":[\"1000000000000000010\"]},\"id\":\"1142380000000000004\",\"guild_id\":\"1000000000000000001\","
+        "\"data\":{\"type\":1,\"name\":\"wake\",\"id\":\"1100000000000000005\"},"
+        "\"channel_id\":\"1000000000000000002\",\"application_id\":\"1100000000000000000\"}}";
+
+    Discord::Bot* bot = nullptr;
+    WebSocketsClient* socket = nullptr;
+
+    void deliver(char* frame) {
+        socket->receive(WStype_TEXT, reinterpret_cast<uint8_t*>(frame), strlen(frame));
+    }
+
+    // Sends TEST_RESPONSES responses from inside the interaction handler, as an application does, and returns how many
+    // allocations the handler's thread made while queueing them.
+    template <typename Respond>
+    uint64_t allocationsPerInteraction(Respond respondOnce) {
+        uint64_t allocations = 0;
+        unsigned long sent = HTTPClient::requests.load();
+        bot->onInteraction([&](const char*, const Discord::Interaction&) {
+            // The first response may set up things that live on, like the responder's own buffers.
+            respondOnce();
+            while (bot->inFlightResponses() > 0) std::this_thread::yield();
+
+            for (int i = 0; i < TEST_RESPONSES; ++i) {
+                uint64_t before = Bench::Allocations::threadCount();
+                respondOnce();
+                allocations += Bench::Allocations::threadCount() - before;
+                // Wait outside the measurement, so every response finds a free slot.
+                while (bot->inFlightResponses() > 0) std::this_thread::yield();
+            }
+            });
+        deliver(interactionCreateFrame);
+        bot->onInteraction(nullptr);
+
+        TEST_ASSERT_EQUAL_UINT32(TEST_RESPONSES + 1, HTTPClient::requests.load() - sent);
+        return allocations;
+    }
+
+    void test_message_response_does_not_allocate() {
+        uint64_t allocations = allocationsPerInteraction([]() {
+            Discord::Bot::MessageResponse response;
+            response.content = "Wake signal sent.";
+            bot->sendCommandResponse(Discord::Bot::InteractionResponse::CHANNEL_MESSAGE_WITH_SOURCE, response);
+            });
+        TEST_ASSERT_EQUAL_UINT32(0, allocations);
+    }
+
+    void test_buttons_response_does_not_allocate() {
+        static const Discord::Bot::MessageResponse::Button buttons[] = {
+            { "Wake", "wake:pc", Discord::Bot::MessageResponse::Button::Style::PRIMARY, false },
+            { "Check status", "status:pc", Discord::Bot::MessageResponse::Button::Style::SECONDARY, false }
+        };
+        uint64_t allocations = allocationsPerInteraction([]() {
+            Discord::Bot::MessageResponse response;
+            response.content = "pc is online.";
+            response.buttons = buttons;
+            response.buttonsLength = sizeof(buttons) / sizeof(buttons[0]);
+            bot->sendCommandResponse(Discord::Bot::InteractionResponse::CHANNEL_MESSAGE_WITH_SOURCE, response);
+            });
+        TEST_ASSERT_EQUAL_UINT32(0, allocations);
+    }
+
+    void test_edit_does_not_allocate() {
+        uint64_t allocations = allocationsPerInteraction([]() {
+            Discord::Bot::MessageResponse response;
+            response.content = "pc is online.";
+            bot->editOriginalResponse(response);
+            });
+        TEST_ASSERT_EQUAL_UINT32(0, allocations);
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+int main(int argc, char** argv) {
+    bot = new Discord::Bot("MTEwMDAwMDAwMDAwMDAwMDAwMA.Gtest.response-path-token-not-a-real-one", 1100000000000000000ULL);
+    bot->login();
+    socket = WebSocketsClient::last;
+    socket->receive(WStype_CONNECTED);
+    socket->hello();
+    deliver(readyFrame);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_message_response_does_not_allocate);
+    RUN_TEST(test_buttons_response_does_not_allocate);
+    RUN_TEST(test_edit_does_not_allocate);
+    return UNITY_END();
+}
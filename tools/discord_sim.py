@@ -0,0 +1,562 @@
+#!/usr/bin/env python3
+#
+# ESP32-Discord-WakeOnCommand v0.1
+# Copyright (C) 2023  Neo Ting Wei Terrence
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""Local stand-in for Discord's gateway and REST API, for load-testing the bot without touching discord.com.
+
+The gateway speaks enough of the protocol for the bot's connection handling: HELLO, heartbeat ACKs, IDENTIFY and
+READY, RESUME (replaying missed dispatches) and RESUMED, and on request RECONNECT and INVALID_SESSION. The REST side
+answers Get Gateway, command registration, channel messages, webhooks and, most importantly, interaction callbacks.
+
+Bursts of INTERACTION_CREATE events are injected at a fixed rate. Each callback is matched to its interaction, and
+the report counts how many were answered within Discord's 3 second deadline.
+
+Only the standard library is needed. Build the firmware with the esp32dev-sim environment, which points the bot here:
+
+    DISCORD_SIM_HOST=192.168.1.10 pio run -e esp32dev-sim -t upload
+    python3 tools/discord_sim.py --advertise 192.168.1.10 --burst 10 --duration 5 --start-after 15
+
+Everything can also be driven while the simulator runs, for example:
+
+    curl -X POST 'http://localhost:8080/sim/burst?rate=20&seconds=3&command=ping'
+    curl -X POST 'http://localhost:8080/sim/reconnect'
+    curl -X POST 'http://localhost:8080/sim/invalid-session?resumable=0'
+    curl -X POST 'http://localhost:8080/sim/disconnect'
+    curl -X POST 'http://localhost:8080/sim/acks?enabled=0'
+    curl 'http://localhost:8080/sim/stats'
+"""
+
+import argparse
+import asyncio
+import base64
+import hashlib
+import itertools
+import json
+import os
+import ssl
+import struct
+import time
+import urllib.parse
+from collections import deque
+
+# Discord's limit for the initial interaction response
+DEADLINE = 3.0
+# How long to wait past the deadline before counting a callback as missing
+GRACE = 5.0
+# Dispatches kept per session for RESUME
+RESUME_BUFFER = 256
+
+WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+EPHEMERAL = 1 << 6
+
+
+def log(message):
+    print(f"[SIM] {time.strftime('%H:%M:%S')} {message}", flush=True)
+
+
+def percentile(sorted_values, fraction):
+    if not sorted_values:
+        return 0.0
+    return sorted_values[min(len(sorted_values) - 1, int(fraction * (len(sorted_values) - 1) + 0.5))]
+
+
+class Snowflakes:
+    """Increasing ids shaped like Discord snowflakes, so the bot parses them the same way."""
+
+    def __init__(self):
+        self._counter = itertools.count(1)
+
+    def next(self):
+        milliseconds = int(time.time() * 1000) - 1420070400000
+        return str((milliseconds << 22) | (next(self._counter) & 0x3FFFFF))
+
+
+class Burst:
+    """One run of injected interactions and the callbacks that answered them."""
+
+    def __init__(self, rate, seconds, command):
+        self.rate = rate
+        self.seconds = seconds
+        self.command = command
+        self.sent = {}
+        self.answered = {}
+        self.response_types = {}
+        self.ephemeral = 0
+        self.started = time.monotonic()
+        self.finished = None
+
+    def record_callback(self, interaction_id, body):
+        sent_at = self.sent.get(interaction_id)
+        if sent_at is None or interaction_id in self.answered:
+            return False
+        self.answered[interaction_id] = time.monotonic() - sent_at
+        response_type = body.get("type")
+        self.response_types[response_type] = self.response_types.get(response_type, 0) + 1
+        if (body.get("data") or {}).get("flags", 0) & EPHEMERAL:
+            self.ephemeral += 1
+        return True
+
+    def report(self):
+        latencies = sorted(self.answered.values())
+        on_time = sum(1 for latency in latencies if latency <= DEADLINE)
+        sent = len(self.sent)
+        elapsed = (self.finished or time.monotonic()) - self.started
+        return {
+            "command": self.command,
+            "rate": self.rate,
+            "seconds": self.seconds,
+            "injected": sent,
+            "injected_per_second": round(sent / elapsed, 2) if elapsed else 0,
+            "answered": len(latencies),
+            "on_time": on_time,
+            "late": len(latencies) - on_time,
+            "missing": sent - len(latencies),
+            "on_time_ratio": round(on_time / sent, 3) if sent else 0,
+            "latency_ms": {
+                "p50": round(percentile(latencies, 0.50) * 1000),
+                "p90": round(percentile(latencies, 0.90) * 1000),
+                "p99": round(percentile(latencies, 0.99) * 1000),
+                "max": round(latencies[-1] * 1000) if latencies else 0,
+            },
+            "response_types": {str(key): value for key, value in self.response_types.items()},
+            "ephemeral": self.ephemeral,
+        }
+
+
+class Session:
+    def __init__(self, session_id):
+        self.session_id = session_id
+        self.sequence = 0
+        self.dispatches = deque(maxlen=RESUME_BUFFER)
+        self.connection = None
+
+
+class GatewayConnection:
+    """Server side of one WebSocket connection, framed by hand (RFC 6455, text frames without fragmentation)."""
+
+    def __init__(self, simulator, reader, writer):
+        self.simulator = simulator
+        self.reader = reader
+        self.writer = writer
+        self.session = None
+        self.closed = False
+
+    async def handshake(self):
+        request = await self.reader.readuntil(b"\r\n\r\n")
+        headers = {}
+        for line in request.decode("latin-1").split("\r\n")[1:]:
+            if ":" in line:
+                name, value = line.split(":", 1)
+                headers[name.strip().lower()] = value.strip()
+        key = headers.get("sec-websocket-key")
+        if not key:
+            self.writer.write(b"HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n")
+            await self.writer.drain()
+            return False
+
+        accept = base64.b64encode(hashlib.sha1((key + WEBSOCKET_GUID).encode()).digest()).decode()
+        self.writer.write(
+            "HTTP/1.1 101 Switching Protocols\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            f"Sec-WebSocket-Accept: {accept}\r\n\r\n".encode())
+        await self.writer.drain()
+        return True
+
+    async def read_frame(self):
+        header = await self.reader.readexactly(2)
+        opcode = header[0] & 0x0F
+        masked = header[1] & 0x80
+        length = header[1] & 0x7F
+        if length == 126:
+            length = struct.unpack("!H", await self.reader.readexactly(2))[0]
+        elif length == 127:
+            length = struct.unpack("!Q", await self.reader.readexactly(8))[0]
+        mask = await self.reader.readexactly(4) if masked else b"\0\0\0\0"
+        payload = bytearray(await self.reader.readexactly(length))
+        for i in range(length):
+            payload[i] ^= mask[i % 4]
+        return opcode, bytes(payload)
+
+    async def write_frame(self, opcode, payload):
+        if self.closed:
+            return
+        header = bytes([0x80 | opcode])
+        if len(payload) < 126:
+            header += bytes([len(payload)])
+        elif len(payload) < 65536:
+            header += bytes([126]) + struct.pack("!H", len(payload))
+        else:
+            header += bytes([127]) + struct.pack("!Q", len(payload))
+        try:
+            self.writer.write(header + payload)
+            await self.writer.drain()
+        except ConnectionError:
+            self.closed = True
+
+    async def send(self, message):
+        await self.write_frame(0x1, json.dumps(message, separators=(",", ":")).encode())
+
+    async def dispatch(self, event, data):
+        """Sends a dispatch with the session's next sequence number, keeping it for RESUME."""
+        if not self.session:
+            return
+        self.session.sequence += 1
+        message = {"t": event, "s": self.session.sequence, "op": 0, "d": data}
+        self.session.dispatches.append(message)
+        await self.send(message)
+
+    async def close(self, code=1000):
+        if self.closed:
+            return
+        await self.write_frame(0x8, struct.pack("!H", code))
+        self.closed = True
+        self.writer.close()
+
+    async def abort(self):
+        """Drops the TCP connection without a close frame, like a network failure."""
+        self.closed = True
+        self.writer.transport.abort()
+
+    async def run(self):
+        if not await self.handshake():
+            return
+        await self.send({"t": None, "s": None, "op": 10,
+                         "d": {"heartbeat_interval": self.simulator.args.heartbeat_interval}})
+        while not self.closed:
+            try:
+                opcode, payload = await self.read_frame()
+            except (asyncio.IncompleteReadError, ConnectionError):
+                break
+            if opcode == 0x8:
+                await self.close()
+                break
+            if opcode == 0x9:
+                await self.write_frame(0xA, payload)
+                continue
+            if opcode != 0x1:
+                continue
+            try:
+                await self.handle(json.loads(payload))
+            except ValueError:
+                log(f"Unparseable frame from the bot: {payload[:80]!r}")
+        self.closed = True
+        if self.session and self.session.connection is self:
+            self.session.connection = None
+        self.simulator.connections.discard(self)
+        log("Gateway connection closed.")
+
+    async def handle(self, message):
+        op = message.get("op")
+        data = message.get("d")
+        simulator = self.simulator
+        if op == 1:
+            simulator.heartbeats += 1
+            if simulator.send_acks:
+                await self.send({"t": None, "s": None, "op": 11, "d": None})
+        elif op == 2:
+            self.session = Session(simulator.snowflakes.next())
+            self.session.connection = self
+            simulator.sessions[self.session.session_id] = self.session
+            log(f"IDENTIFY with intents {data.get('intents')}, session {self.session.session_id}.")
+            await self.dispatch("READY", {
+                "v": 10,
+                "user": {"id": simulator.args.application_id, "username": "SimBot", "discriminator": "0",
+                         "bot": True, "avatar": None},
+                "session_type": "normal",
+                "session_id": self.session.session_id,
+                "resume_gateway_url": f"{simulator.gateway_scheme}://{simulator.args.advertise}",
+                "guilds": [{"unavailable": True, "id": simulator.args.guild_id}],
+                "application": {"id": simulator.args.application_id, "flags": 0},
+            })
+        elif op == 6:
+            session = simulator.sessions.get(data.get("session_id"))
+            if not session:
+                log("RESUME of an unknown session, sending INVALID_SESSION.")
+                await self.send({"t": None, "s": None, "op": 9, "d": False})
+                return
+            self.session = session
+            session.connection = self
+            missed = [m for m in session.dispatches if m["s"] > data.get("seq", 0)]
+            log(f"RESUME of session {session.session_id} from {data.get('seq')}, replaying {len(missed)}.")
+            for message in missed:
+                await self.send(message)
+            await self.dispatch("RESUMED", {})
+        elif op == 3:
+            simulator.presence_updates += 1
+
+
+class Simulator:
+    def __init__(self, args):
+        self.args = args
+        self.snowflakes = Snowflakes()
+        self.sessions = {}
+        self.connections = set()
+        self.bursts = []
+        self.pending = {}
+        self.send_acks = True
+        self.heartbeats = 0
+        self.presence_updates = 0
+        self.callbacks = 0
+        self.unmatched_callbacks = 0
+        self.requests = 0
+        self.gateway_scheme = "wss" if args.cert else "ws"
+
+    def live_connections(self):
+        return [c for c in self.connections if c.session and not c.closed]
+
+    # ----- Interactions -----
+
+    def interaction(self, command):
+        interaction_id = self.snowflakes.next()
+        return interaction_id, {
+            "version": 1,
+            "type": 2,
+            "id": interaction_id,
+            "token": f"sim-{interaction_id}-" + base64.urlsafe_b64encode(os.urandom(120)).decode().rstrip("="),
+            "application_id": self.args.application_id,
+            "guild_id": self.args.guild_id,
+            "channel_id": self.args.channel_id,
+            "locale": "en-GB",
+            "guild_locale": "en-US",
+            "member": {
+                "user": {"id": self.args.user_id, "username": "loadtester", "discriminator": "0",
+                         "global_name": "Load Tester", "avatar": None},
+                "roles": [],
+                "permissions": "562949953421311",
+                "joined_at": "2021-02-03T04:05:06.000000+00:00",
+                "deaf": False,
+                "mute": False,
+            },
+            "data": {"type": 1, "name": command, "id": "1100000000000000005"},
+            "app_permissions": "562949953421311",
+        }
+
+    async def run_burst(self, rate, seconds, command):
+        connections = self.live_connections()
+        if not connections:
+            log("No bot connected, burst skipped.")
+            return None
+        burst = Burst(rate, seconds, command)
+        self.bursts.append(burst)
+        log(f"Burst: {rate}/s of /{command} for {seconds} s.")
+
+        total = int(rate * seconds)
+        start = time.monotonic()
+        for i in range(total):
+            # Evenly spaced, catching up rather than drifting if the loop falls behind
+            delay = start + i / rate - time.monotonic()
+            if delay > 0:
+                await asyncio.sleep(delay)
+            interaction_id, data = self.interaction(command)
+            burst.sent[interaction_id] = time.monotonic()
+            self.pending[interaction_id] = burst
+            await connections[i % len(connections)].dispatch("INTERACTION_CREATE", data)
+        burst.finished = time.monotonic()
+
+        await asyncio.sleep(DEADLINE + GRACE)
+        report = burst.report()
+        log("Burst report: " + json.dumps(report))
+        return report
+
+    def record_callback(self, interaction_id, body):
+        self.callbacks += 1
+        burst = self.pending.pop(interaction_id, None)
+        if not burst or not burst.record_callback(interaction_id, body):
+            self.unmatched_callbacks += 1
+
+    # ----- Control -----
+
+    async def reconnect(self):
+        for connection in self.live_connections():
+            await connection.send({"t": None, "s": None, "op": 7, "d": None})
+        log("Sent RECONNECT.")
+
+    async def invalidate(self, resumable):
+        for connection in self.live_connections():
+            await connection.send({"t": None, "s": None, "op": 9, "d": resumable})
+            if not resumable:
+                self.sessions.pop(connection.session.session_id, None)
+        log(f"Sent INVALID_SESSION (resumable: {resumable}).")
+
+    async def disconnect(self):
+        for connection in list(self.connections):
+            await connection.abort()
+        log("Dropped every gateway connection.")
+
+    def stats(self):
+        return {
+            "connections": len(self.live_connections()),
+            "sessions": len(self.sessions),
+            "heartbeats": self.heartbeats,
+            "acks_enabled": self.send_acks,
+            "presence_updates": self.presence_updates,
+            "rest_requests": self.requests,
+            "callbacks": self.callbacks,
+            "unmatched_callbacks": self.unmatched_callbacks,
+            "bursts": [burst.report() for burst in self.bursts],
+        }
+
+    # ----- REST -----
+
+    async def route(self, method, path, query, body):
+        """Returns (status, JSON body or None)."""
+        api = self.args.api_uri
+        parts = [p for p in path.split("/") if p]
+
+        if path.startswith("/sim/"):
+            action = parts[1] if len(parts) > 1 else ""
+            if action == "stats":
+                return 200, self.stats()
+            if action == "burst":
+                asyncio.ensure_future(self.run_burst(float(query.get("rate", 10)), float(query.get("seconds", 1)),
+                                                     query.get("command", "ping")))
+                return 202, {"started": True}
+            if action == "reconnect":
+                await self.reconnect()
+                return 200, {}
+            if action == "invalid-session":
+                await self.invalidate(query.get("resumable", "0") not in ("0", "false"))
+                return 200, {}
+            if action == "disconnect":
+                await self.disconnect()
+                return 200, {}
+            if action == "acks":
+                self.send_acks = query.get("enabled", "1") not in ("0", "false")
+                log(f"Heartbeat ACKs {'enabled' if self.send_acks else 'disabled'}.")
+                return 200, {"acks_enabled": self.send_acks}
+            return 404, {"message": "Unknown simulator action"}
+
+        if not path.startswith(api):
+            return 404, {"message": "404: Not Found", "code": 0}
+        parts = [p for p in path[len(api):].split("/") if p]
+
+        if parts in (["gateway"], ["gateway", "bot"]):
+            return 200, {"url": f"{self.gateway_scheme}://{self.args.advertise}"}
+        if len(parts) == 4 and parts[0] == "interactions" and parts[3] == "callback" and method == "POST":
+            self.record_callback(parts[1], body or {})
+            return 204, None
+        if parts and parts[0] == "applications" and parts[-1] == "commands" and method in ("POST", "PUT"):
+            return 201, {"id": self.snowflakes.next(), "application_id": self.args.application_id,
+                         **(body if isinstance(body, dict) else {})}
+        if parts and parts[0] == "applications" and method == "DELETE":
+            return 204, None
+        if len(parts) == 3 and parts[0] == "channels" and parts[2] == "messages" and method == "POST":
+            return 200, {"id": self.snowflakes.next(), "channel_id": parts[1],
+                         "content": (body or {}).get("content", "")}
+        if parts and parts[0] == "webhooks":
+            return 204, None
+        return 404, {"message": "404: Not Found", "code": 0}
+
+    async def serve_rest(self, reader, writer):
+        """HTTP/1.1 with keep-alive, since the bot holds its REST connection open between requests."""
+        try:
+            while True:
+                try:
+                    head = await reader.readuntil(b"\r\n\r\n")
+                except (asyncio.IncompleteReadError, ConnectionError):
+                    break
+                lines = head.decode("latin-1").split("\r\n")
+                method, target, _ = lines[0].split(" ", 2)
+                headers = {}
+                for line in lines[1:]:
+                    if ":" in line:
+                        name, value = line.split(":", 1)
+                        headers[name.strip().lower()] = value.strip()
+                raw = await reader.readexactly(int(headers.get("content-length", 0)))
+
+                body = None
+                if raw:
+                    try:
+                        body = json.loads(raw)
+                    except ValueError:
+                        pass
+                url = urllib.parse.urlsplit(target)
+                query = dict(urllib.parse.parse_qsl(url.query))
+                self.requests += 1
+                status, response = await self.route(method, url.path, query, body)
+
+                payload = json.dumps(response).encode() if response is not None else b""
+                reason = {200: "OK", 201: "Created", 202: "Accepted", 204: "No Content", 404: "Not Found"}[status]
+                writer.write(f"HTTP/1.1 {status} {reason}\r\nContent-Type: application/json\r\n"
+                             f"Content-Length: {len(payload)}\r\nConnection: keep-alive\r\n\r\n".encode() + payload)
+                await writer.drain()
+                if headers.get("connection", "").lower() == "close":
+                    break
+        finally:
+            writer.close()
+
+    async def serve_gateway(self, reader, writer):
+        log(f"Gateway connection from {writer.get_extra_info('peername')}.")
+        connection = GatewayConnection(self, reader, writer)
+        self.connections.add(connection)
+        await connection.run()
+
+    async def scheduled(self):
+        if not self.args.burst:
+            return
+        log(f"Waiting {self.args.start_after} s for the bot to connect.")
+        await asyncio.sleep(self.args.start_after)
+        await self.run_burst(self.args.burst, self.args.duration, self.args.command)
+
+    async def main(self):
+        context = None
+        if self.args.cert:
+            context = ssl.create_default_context(ssl.Purpose.CLIENT_AUTH)
+            context.load_cert_chain(self.args.cert, self.args.key)
+        rest = await asyncio.start_server(self.serve_rest, self.args.bind, self.args.rest_port, ssl=context)
+        gateway = await asyncio.start_server(self.serve_gateway, self.args.bind, self.args.gateway_port, ssl=context)
+        log(f"REST on port {self.args.rest_port}, gateway on port {self.args.gateway_port} "
+            f"({'TLS' if context else 'plain'}), advertising {self.gateway_scheme}://{self.args.advertise}.")
+        async with rest, gateway:
+            await asyncio.gather(rest.serve_forever(), gateway.serve_forever(), self.scheduled())
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--bind", default="0.0.0.0", help="address to listen on")
+    parser.add_argument("--advertise", default=None,
+                        help="gateway host handed to the bot, without a port (default: this machine's hostname)")
+    parser.add_argument("--rest-port", type=int, default=8080)
+    parser.add_argument("--gateway-port", type=int, default=8081)
+    parser.add_argument("--cert", help="PEM certificate, serves https and wss instead of plain connections")
+    parser.add_argument("--key", help="PEM private key for --cert")
+    parser.add_argument("--api-uri", default="/api/v10", help="must match DISCORD_API_URI")
+    parser.add_argument("--heartbeat-interval", type=int, default=41250, help="ms, sent in HELLO")
+    parser.add_argument("--application-id", default="1100000000000000000")
+    parser.add_argument("--guild-id", default="1000000000000000001")
+    parser.add_argument("--channel-id", default="1000000000000000002")
+    parser.add_argument("--user-id", default="1000000000000000003",
+                        help="invoking user of injected interactions, use an owner id to test /wake")
+    parser.add_argument("--burst", type=float, default=0, help="interactions per second to inject once started")
+    parser.add_argument("--duration", type=float, default=5, help="seconds the --burst lasts")
+    parser.add_argument("--start-after", type=float, default=15, help="seconds to wait before the --burst")
+    parser.add_argument("--command", default="ping", help="command name of injected interactions")
+    args = parser.parse_args()
+    if args.cert and not args.key:
+        parser.error("--cert needs --key")
+    if not args.advertise:
+        import socket
+        args.advertise = socket.gethostname()
+    return args
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(Simulator(parse_args()).main())
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+#
+# ESP32-Discord-WakeOnCommand v0.1
+# Copyright (C) 2023  Neo Ting Wei Terrence
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""Converts a trace dump from the bot (see include/trace.h) into Chrome trace JSON.
+
+Open the result in chrome://tracing or https://ui.perfetto.dev to see each task on its own track: frames being parsed,
+handlers running and responses being posted, with arrows from each queued response to the task that sent it.
+
+The input is either the trace.bin the bot posts to the webhook for /trace, or a serial monitor log holding a
+[TRACE] begin ... [TRACE] end dump, of which the last complete one is used:
+
+    python3 tools/trace2chrome.py monitor.log -o trace.json
+"""
+
+import argparse
+import json
+import re
+import struct
+import sys
+
+HEADER = struct.Struct("<4sHHII")
+NAME_SIZE = 16
+RECORD = struct.Struct("<IIBBH")
+
+# Event id: (name, phase). Begin/end pairs become spans on their task's track, the rest instant events.
+EVENTS = {
+    1: ("frame", "B"),
+    2: ("frame", "E"),
+    3: ("handler", "B"),
+    4: ("handler", "E"),
+    5: ("response queued", "i"),
+    6: ("POST", "B"),
+    7: ("POST", "E"),
+    8: ("heartbeat", "i"),
+    9: ("heartbeat ACK", "i"),
+    10: ("WOL packet", "i"),
+}
+# What the argument of each event means, for the event's details pane
+ARGS = {1: "length", 2: "op", 3: "interaction", 4: "interaction", 5: "slot", 6: "slot", 7: "status", 8: "sequence",
+        10: "sent"}
+
+
+def load(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data.startswith(b"DTRC"):
+        return data
+
+    dump, lines = None, None
+    for line in data.decode("utf-8", "replace").splitlines():
+        match = re.search(r"\[TRACE\] (.*)$", line)
+        if not match:
+            continue
+        text = match.group(1).strip()
+        if text.startswith("begin"):
+            lines = []
+        elif text == "end":
+            if lines is not None:
+                dump = bytes.fromhex("".join(lines))
+            lines = None
+        elif lines is not None:
+            lines.append(text)
+    if dump is None:
+        sys.exit(f"{path}: no complete trace dump found")
+    return dump
+
+
+def convert(data):
+    magic, version, task_count, event_count, now = HEADER.unpack_from(data)
+    if magic != b"DTRC" or version != 1:
+        sys.exit(f"unsupported trace (magic {magic!r}, version {version})")
+    offset = HEADER.size
+    names = []
+    for _ in range(task_count):
+        names.append(data[offset:offset + NAME_SIZE].split(b"\0")[0].decode("ascii", "replace"))
+        offset += NAME_SIZE
+
+    events = [{"name": "thread_name", "ph": "M", "pid": 1, "tid": tid, "args": {"name": name}}
+              for tid, name in enumerate(names)]
+    previous, wraps = None, 0
+    open_spans = {}
+    # Flow id of the last response queued in each slot
+    queued = {}
+    for _ in range(event_count):
+        time, arg, event, task, _ = RECORD.unpack_from(data, offset)
+        offset += RECORD.size
+        # micros() wraps every 71 minutes; events are in recording order, so any step back is a wrap
+        if previous is not None and time < previous and previous - time > 1 << 31:
+            wraps += 1
+        previous = time
+        ts = time + (wraps << 32)
+
+        name, phase = EVENTS.get(event, (f"event {event}", "i"))
+        record = {"name": name, "ph": phase, "ts": ts, "pid": 1, "tid": task}
+        if event in ARGS:
+            record["args"] = {ARGS[event]: arg}
+        if phase == "i":
+            record["s"] = "t"
+        # A ring that has wrapped can start inside a span; drop ends without a beginning
+        key = (task, name)
+        if phase == "B":
+            open_spans[key] = open_spans.get(key, 0) + 1
+        elif phase == "E":
+            if not open_spans.get(key):
+                continue
+            open_spans[key] -= 1
+        events.append(record)
+
+        # Link each queued response to the POST that sends it
+        if event == 5:
+            events.append({"name": "response", "cat": "response", "ph": "s", "id": f"slot{arg}-{ts}", "ts": ts,
+                           "pid": 1, "tid": task})
+            queued[arg] = f"slot{arg}-{ts}"
+        elif event == 6 and arg in queued:
+            events.append({"name": "response", "cat": "response", "ph": "f", "bp": "e", "id": queued.pop(arg),
+                           "ts": ts, "pid": 1, "tid": task})
+    return {"traceEvents": events, "displayTimeUnit": "ms"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("input", help="trace.bin, or a serial log with a [TRACE] dump")
+    parser.add_argument("-o", "--output", help="where to write the JSON (default: stdout)")
+    args = parser.parse_args()
+
+    trace = convert(load(args.input))
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()